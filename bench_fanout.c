@@ -0,0 +1,413 @@
+/* Benchmark of the fan-out from a room to the people in it. A room of players take turns
+ * while spectators watch, and we time every turn: from a player sending a guess until the
+ * next "Your guess?" prompt arrives. We also count the bytes each player and spectator is
+ * sent per turn and, given the server's pid, how much CPU the server spends per turn.
+ * Spectators are read by a thread of their own, so the turns aren't timed with our own
+ * work for a big crowd in them.
+ *
+ * Usage: bench_fanout [-p players] [-s spectators] [-t turns] [-d] [-P server pid]
+ *   -p  players in the room (2 by default). Start the server with this room size.
+ *   -s  spectators watching the room (0 by default).
+ *   -t  turns to play (1000 by default).
+ *   -d  the players ask for delta board updates instead of the full board.
+ *   -P  the server's pid, to read its CPU time from /proc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef PORT
+    #define PORT 54623
+#endif
+#define PROMPT "Your guess?"
+#define BOARD "Word to guess"   // Part of every full board.
+#define NEW_GAME "new game"     // Part of the message sent when a game ends.
+#define INVALID "Invalid guess" // The letter was guessed before, try the next one.
+#define START_WAIT 30000        // Milliseconds to wait for the room and spectators to be ready.
+#define TURN_WAIT 5000          // Milliseconds to wait for a turn before giving up.
+#define PLAYER_BUF 8192
+
+struct crowd {
+    int *fds;
+    int count;
+    int stop;             // Set to tell the thread reading the crowd to finish.
+    long bytes;           // Everything the crowd has been sent since it started being read.
+};
+
+struct player {
+    int fd;
+    char buf[PLAYER_BUF]; // Everything read since the last prompt.
+    int len;
+    long bytes;           // Everything read since the game started being timed.
+};
+
+/* Connect to the server on this machine and return the socket once the server has
+ * welcomed it. The server's listen queue is short, so waiting for the welcome before
+ * making the next connection keeps it from dropping any.
+ */
+int connect_to_server(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        exit(1);
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("connect");
+        exit(1);
+    }
+    char buf[256];
+    if (read(fd, buf, sizeof(buf)) <= 0) {
+        fprintf(stderr, "The server hung up before welcoming us\n");
+        exit(1);
+    }
+    return fd;
+}
+
+/* Send line to fd with a network newline.
+ */
+void send_line(int fd, const char *line) {
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "%s\r\n", line);
+    if (write(fd, buf, len) != len) {
+        perror("write");
+        exit(1);
+    }
+}
+
+/* Read whatever p has been sent onto the end of p->buf, keeping only the newest part if
+ * it fills up. Exit if the server hung up.
+ */
+void read_player(struct player *p) {
+    if (p->len > PLAYER_BUF / 2) {
+        memmove(p->buf, p->buf + p->len - PLAYER_BUF / 4, PLAYER_BUF / 4);
+        p->len = PLAYER_BUF / 4;
+    }
+    int n = recv(p->fd, p->buf + p->len, PLAYER_BUF - 1 - p->len, MSG_DONTWAIT);
+    if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        fprintf(stderr, "The server hung up on a player\n");
+        exit(1);
+    }
+    if (n > 0) {
+        p->len += n;
+        p->buf[p->len] = '\0';
+        p->bytes += n;
+    }
+}
+
+/* Return how many times s appears in buf.
+ */
+int count(const char *buf, const char *s) {
+    int n = 0;
+    for (const char *at = strstr(buf, s); at != NULL; at = strstr(at + 1, s)) {
+        n++;
+    }
+    return n;
+}
+
+/* Return the CPU time process pid has used, in seconds, or -1 if it can't be read.
+ */
+double cpu_seconds(int pid) {
+    char path[64];
+    char stat[1024];
+    sprintf(path, "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    int n = fread(stat, 1, sizeof(stat) - 1, fp);
+    fclose(fp);
+    stat[n > 0 ? n : 0] = '\0';
+
+    // The command name is in brackets and may hold spaces, so start after it.
+    // utime and stime are the 12th and 13th fields after it.
+    char *after = strrchr(stat, ')');
+    unsigned long utime, stime;
+    if (after == NULL || sscanf(after + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                                &utime, &stime) != 2) {
+        return -1;
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* Read everything the spectators in arg, a struct crowd, are sent until told to stop.
+ * Exit if the server hangs up on any of them.
+ */
+void *read_crowd(void *arg) {
+    struct crowd *c = arg;
+    int ep = epoll_create1(0);
+    if (ep == -1) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    for (int i = 0; i < c->count; i++) {
+        struct epoll_event ev = {EPOLLIN, {.u32 = i}};
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, c->fds[i], &ev) == -1) {
+            perror("epoll_ctl");
+            exit(1);
+        }
+    }
+    struct epoll_event ready[256];
+    char buf[4096];
+    while (!__atomic_load_n(&(c->stop), __ATOMIC_RELAXED)) {
+        int n = epoll_wait(ep, ready, 256, 100);
+        for (int i = 0; i < n; i++) {
+            int got = read(c->fds[ready[i].data.u32], buf, sizeof(buf));
+            if (got <= 0) {
+                fprintf(stderr, "The server hung up on spectator %u\n", ready[i].data.u32);
+                exit(1);
+            }
+            c->bytes += got;
+        }
+    }
+    close(ep);
+    return NULL;
+}
+
+double now_us(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int num_players = 2;
+    int num_specs = 0;
+    int turns = 1000;
+    int delta = 0;
+    int server_pid = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:t:dP:")) != -1) {
+        switch (opt) {
+        case 'p': num_players = strtol(optarg, NULL, 10); break;
+        case 's': num_specs = strtol(optarg, NULL, 10); break;
+        case 't': turns = strtol(optarg, NULL, 10); break;
+        case 'd': delta = 1; break;
+        case 'P': server_pid = strtol(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-p players] [-s spectators] [-t turns] [-d] [-P server pid]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (num_players < 1 || num_specs < 0 || turns < 1) {
+        fprintf(stderr, "Need at least one player and one turn\n");
+        exit(1);
+    }
+
+    // Every player and spectator needs a socket of its own.
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    // The players come first in fds, then the spectators.
+    int num_fds = num_players + num_specs;
+    struct pollfd *fds = calloc(num_fds, sizeof(struct pollfd));
+    struct player *players = calloc(num_players, sizeof(struct player));
+    char *synced = calloc(num_fds, 1); // Whether each client has been sent all it needs to start.
+    double *latency = malloc(turns * sizeof(double));
+    if (!fds || !players || !synced || !latency) {
+        perror("malloc");
+        exit(1);
+    }
+
+    // Name the players after our pid so a second run can't clash with a first one still leaving.
+    for (int i = 0; i < num_players; i++) {
+        char name[32];
+        sprintf(name, "bench%d_%d", (int)getpid(), i);
+        players[i].fd = connect_to_server();
+        send_line(players[i].fd, name);
+        fds[i].fd = players[i].fd;
+        fds[i].events = POLLIN;
+    }
+
+    // Wait for our room to start, so we know which one to watch.
+    int room_id = -1;
+    double start = now_us();
+    while (room_id == -1) {
+        if (now_us() - start > START_WAIT * 1000.0) {
+            fprintf(stderr, "The room didn't start. Is the server running with a room size of %d?\n",
+                    num_players);
+            exit(1);
+        }
+        poll(fds, num_players, 100);
+        for (int i = 0; i < num_players; i++) {
+            read_player(&players[i]);
+            char *welcome = strstr(players[i].buf, "Welcome to game ");
+            if (welcome != NULL) {
+                room_id = strtol(welcome + strlen("Welcome to game "), NULL, 10);
+            }
+        }
+    }
+    if (delta) {
+        for (int i = 0; i < num_players; i++) {
+            send_line(players[i].fd, "/delta");
+        }
+    }
+
+    char watch[32];
+    sprintf(watch, "/watch %d", room_id);
+    for (int i = num_players; i < num_fds; i++) {
+        fds[i].fd = connect_to_server();
+        fds[i].events = POLLIN;
+        send_line(fds[i].fd, watch);
+    }
+
+    // Keep reading until every spectator has a board, and every delta player has been sent
+    // the full board /delta answers with on top of the one the room started with.
+    char buf[4096];
+    int num_synced = 0;
+    start = now_us();
+    while (num_synced < num_fds) {
+        if (now_us() - start > START_WAIT * 1000.0) {
+            fprintf(stderr, "Only %d of %d clients were ready to start\n", num_synced, num_fds);
+            exit(1);
+        }
+        poll(fds, num_fds, 100);
+        for (int i = 0; i < num_players; i++) {
+            read_player(&players[i]);
+            if (!synced[i] && count(players[i].buf, BOARD) >= (delta ? 2 : 1)) {
+                synced[i] = 1;
+                num_synced++;
+            }
+        }
+        for (int i = num_players; i < num_fds; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                int n = read(fds[i].fd, buf, sizeof(buf) - 1);
+                if (n <= 0) {
+                    fprintf(stderr, "The server hung up on spectator %d\n", i - num_players);
+                    exit(1);
+                }
+                buf[n] = '\0';
+                if (!synced[i] && strstr(buf, BOARD) != NULL) {
+                    synced[i] = 1;
+                    num_synced++;
+                }
+            }
+        }
+    }
+
+    // From here on the players are polled alone, and the crowd is read by its own thread.
+    int *spec_fds = malloc((num_specs + 1) * sizeof(int));
+    if (!spec_fds) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < num_specs; i++) {
+        spec_fds[i] = fds[num_players + i].fd;
+    }
+    struct crowd crowd = {spec_fds, num_specs, 0, 0};
+    pthread_t crowd_thread;
+    if (num_specs > 0 && pthread_create(&crowd_thread, NULL, read_crowd, &crowd) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    // Play. Letters are guessed in order, starting again from a whenever a new game starts.
+    int next_letter = 0;
+    int done = 0;
+    double sent_at = 0; // When the last guess was sent, 0 before the first prompt.
+    int to_move = -1;   // The player who was last prompted.
+    int first = 1;      // The first prompt may have come in already, so don't wait for it.
+    for (int i = 0; i < num_players; i++) {
+        players[i].bytes = 0;
+    }
+    double cpu_start = server_pid ? cpu_seconds(server_pid) : -1;
+    double bench_start = now_us();
+    while (done < turns) {
+        if (poll(fds, num_players, first ? 0 : TURN_WAIT) == 0 && !first) {
+            fprintf(stderr, "Gave up after waiting %d ms for turn %d\n", TURN_WAIT, done);
+            exit(1);
+        }
+        first = 0;
+
+        for (int i = 0; i < num_players; i++) {
+            if (fds[i].revents & POLLIN) {
+                read_player(&players[i]);
+            }
+            if (i == to_move && strstr(players[i].buf, INVALID) != NULL) {
+                players[i].len = 0;
+                players[i].buf[0] = '\0';
+                char guess[2] = {'a' + next_letter++ % 26, '\0'};
+                send_line(players[i].fd, guess);
+                continue;
+            }
+            if (strstr(players[i].buf, PROMPT) == NULL) {
+                continue;
+            }
+
+            if (sent_at != 0) {
+                latency[done++] = now_us() - sent_at;
+            }
+            if (strstr(players[i].buf, NEW_GAME) != NULL) {
+                next_letter = 0;
+            }
+            // The others were sent everything before this prompt, so throw that away too.
+            for (int j = 0; j < num_players; j++) {
+                if (j != i) {
+                    read_player(&players[j]);
+                }
+                players[j].len = 0;
+                players[j].buf[0] = '\0';
+            }
+            if (done == turns) {
+                break;
+            }
+            to_move = i;
+            char guess[2] = {'a' + next_letter++ % 26, '\0'};
+            sent_at = now_us();
+            send_line(players[i].fd, guess);
+        }
+    }
+    double elapsed = now_us() - bench_start;
+    double cpu_end = server_pid ? cpu_seconds(server_pid) : -1;
+    if (num_specs > 0) {
+        __atomic_store_n(&(crowd.stop), 1, __ATOMIC_RELAXED);
+        pthread_join(crowd_thread, NULL);
+    }
+
+    qsort(latency, turns, sizeof(double), compare_doubles);
+    double total = 0;
+    long player_bytes = 0;
+    for (int i = 0; i < turns; i++) {
+        total += latency[i];
+    }
+    for (int i = 0; i < num_players; i++) {
+        player_bytes += players[i].bytes;
+    }
+    printf("%d %s players, %d spectators, %d turns in %.2f s\n",
+           num_players, delta ? "delta" : "full", num_specs, turns, elapsed / 1e6);
+    printf("turn latency: mean %.0f us, p50 %.0f us, p99 %.0f us, max %.0f us\n",
+           total / turns, latency[turns / 2], latency[turns * 99 / 100], latency[turns - 1]);
+    printf("players were sent %.1f bytes per turn each\n", (double)player_bytes / num_players / turns);
+    if (num_specs > 0) {
+        printf("spectators were sent %.1f bytes per turn each\n", (double)crowd.bytes / num_specs / turns);
+    }
+    if (cpu_start >= 0 && cpu_end >= 0) {
+        printf("server used %.1f us of CPU per turn\n", (cpu_end - cpu_start) * 1e6 / turns);
+    } else if (server_pid) {
+        fprintf(stderr, "Couldn't read the CPU time of process %d\n", server_pid);
+    }
+    return 0;
+}
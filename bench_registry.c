@@ -0,0 +1,127 @@
+/* Benchmark of the name registry with a server's worth of players in it. Fills the
+ * registry with n names and times, per name:
+ *   - joins: reserving a new name, and a name that is already taken
+ *   - churn: one player leaving and another joining, with all n names registered
+ *   - lookups from other threads while one thread churns
+ * and, for comparison, checking a name by scanning a list with strcmp, as the server did
+ * before it had a registry.
+ *
+ * Usage: bench_registry [names] [lookup threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "registry.h"
+
+#define SCAN_TRIES 200 // The scan is slow, so only time this many.
+
+struct registry reg;
+int num_names;
+int stop = 0;          // Set to tell the lookup threads to finish.
+
+double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* Look up random names in reg until told to stop, and return how many in a malloced long.
+ */
+void *look_up(void *arg) {
+    unsigned seed = (unsigned)(size_t)arg;
+    long *lookups = malloc(sizeof(long));
+    char name[MAX_NAME];
+    *lookups = 0;
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        sprintf(name, "player%d", rand_r(&seed) % num_names);
+        name_in_use(&reg, name);
+        (*lookups)++;
+    }
+    return lookups;
+}
+
+int main(int argc, char **argv) {
+    num_names = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    int num_threads = argc > 2 ? strtol(argv[2], NULL, 10) : 2;
+    if (num_names < 2 || num_names > REGISTRY_SIZE / 4 * 3 - 1 || num_threads < 0) {
+        fprintf(stderr, "Usage: %s [names, 2 to %d] [lookup threads]\n", argv[0], REGISTRY_SIZE / 4 * 3 - 1);
+        exit(1);
+    }
+    init_registry(&reg, REGISTRY_SIZE);
+    const char **interned = malloc(num_names * sizeof(char *));
+    if (!interned) {
+        perror("malloc");
+        exit(1);
+    }
+    char name[MAX_NAME];
+
+    double start = now_ns();
+    for (int i = 0; i < num_names; i++) {
+        sprintf(name, "player%d", i);
+        if (reserve_name(&reg, name, &interned[i]) != NAME_RESERVED) {
+            fprintf(stderr, "Could not reserve %s\n", name);
+            exit(1);
+        }
+    }
+    printf("%d names registered\n", num_names);
+    printf("join with a new name:      %6.0f ns\n", (now_ns() - start) / num_names);
+
+    start = now_ns();
+    for (int i = 0; i < num_names; i++) {
+        sprintf(name, "player%d", i);
+        const char *unused;
+        if (reserve_name(&reg, name, &unused) != NAME_TAKEN) {
+            fprintf(stderr, "%s should have been taken\n", name);
+            exit(1);
+        }
+    }
+    printf("join with a taken name:    %6.0f ns\n", (now_ns() - start) / num_names);
+
+    // Every player leaves and someone new takes their place, while other threads look names up.
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    for (int t = 0; t < num_threads; t++) {
+        if (pthread_create(&threads[t], NULL, look_up, (void *)(size_t)(t + 1)) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    start = now_ns();
+    for (int i = 0; i < num_names; i++) {
+        release_name(&reg, interned[i]);
+        sprintf(name, "player%d", i); // The same name, so the lookups keep finding names.
+        if (reserve_name(&reg, name, &interned[i]) != NAME_RESERVED) {
+            fprintf(stderr, "Could not reserve %s again\n", name);
+            exit(1);
+        }
+    }
+    double churn = now_ns() - start;
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    long lookups = 0;
+    for (int t = 0; t < num_threads; t++) {
+        long *n;
+        pthread_join(threads[t], (void **)&n);
+        lookups += *n;
+        free(n);
+    }
+    printf("leave and join:            %6.0f ns, with %d threads looking up %.1f M names/s\n",
+           churn / num_names, num_threads, lookups / churn * 1e3);
+
+    // The old way: walk a list of everyone, comparing names.
+    start = now_ns();
+    int found = 0;
+    for (int i = 0; i < SCAN_TRIES; i++) {
+        sprintf(name, "player%d", (int)((long)i * num_names / SCAN_TRIES)); // Spread along the list.
+        for (int j = 0; j < num_names; j++) {
+            if (strcmp(interned[j], name) == 0) {
+                found++;
+                break;
+            }
+        }
+    }
+    printf("check by scanning a list:  %6.0f ns (%d found)\n", (now_ns() - start) / SCAN_TRIES, found);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* Benchmark of the solver behind /hint and bots. Plays games on a dictionary, always
+ * guessing the letter best_letter picks, and times each call. For comparison it
+ * also finds the letter on every board by scanning the whole dictionary, as a
+ * solver without an index would, and checks the two always pick the same letter.
+ *
+ * Usage: bench_solver <dictionary filename> [games]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gameplay.h"
+#include "solver.h"
+
+struct dictionary dict;
+struct solver solver;
+
+double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* Return 1 if word could be the word on game's board, 0 otherwise.
+ */
+int fits_board(const char *word, struct game_state *game) {
+    if (strlen(word) != strlen(game->guess)) {
+        return 0;
+    }
+    for (int i = 0; word[i] != '\0'; i++) {
+        int c = word[i] - 'a';
+        if (c < 0 || c >= NUM_LETTERS) { // The solver leaves these words out too.
+            return 0;
+        }
+        if (game->guess[i] != '-' ? word[i] != game->guess[i] : game->letters_guessed[c]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Return the unguessed letter in the most words that fit game's board, by checking
+ * every word in the dictionary. Ties go to the earlier letter, as in best_letter.
+ */
+char scan_letter(struct game_state *game) {
+    int counts[NUM_LETTERS] = {0};
+    for (int w = 0; w < dict.size; w++) {
+        if (!fits_board(dict.words[w], game)) {
+            continue;
+        }
+        int has[NUM_LETTERS] = {0};
+        for (char *x = dict.words[w]; *x != '\0'; x++) {
+            has[*x - 'a'] = 1;
+        }
+        for (int c = 0; c < NUM_LETTERS; c++) {
+            counts[c] += has[c];
+        }
+    }
+    char best = '\0';
+    int best_count = 0;
+    for (int c = 0; c < NUM_LETTERS; c++) {
+        if (!game->letters_guessed[c] && counts[c] > best_count) {
+            best_count = counts[c];
+            best = 'a' + c;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int num_games = argc > 2 ? strtol(argv[2], NULL, 10) : 200;
+    if (argc < 2 || num_games < 1) {
+        fprintf(stderr, "Usage: %s <dictionary filename> [games]\n", argv[0]);
+        exit(1);
+    }
+    load_dictionary(&dict, argv[1]);
+    double start = now_ns();
+    init_solver(&solver, &dict);
+    printf("%d words, index built in %.0f ms\n", dict.size, (now_ns() - start) / 1e6);
+
+    struct game_state game;
+    srandom(1); // The same games every run.
+    long calls = 0;
+    int disagreed = 0;
+    double solver_ns = 0;
+    double scan_ns = 0;
+    for (int g = 0; g < num_games; g++) {
+        // Set up the board the way init_game does, without its chatter.
+        strcpy(game.word, dict.words[random() % dict.size]);
+        memset(game.guess, '-', strlen(game.word));
+        game.guess[strlen(game.word)] = '\0';
+        memset(game.letters_guessed, 0, sizeof(game.letters_guessed));
+        game.guesses_left = MAX_GUESSES;
+
+        while (game.guesses_left > 0 && strchr(game.guess, '-') != NULL) {
+            start = now_ns();
+            char letter = best_letter(&solver, &game);
+            solver_ns += now_ns() - start;
+            start = now_ns();
+            char scanned = scan_letter(&game);
+            scan_ns += now_ns() - start;
+            calls++;
+            disagreed += letter != scanned;
+            if (letter == '\0') { // The word has letters the solver doesn't index.
+                break;
+            }
+
+            game.letters_guessed[letter - 'a'] = 1;
+            int hit = 0;
+            for (int i = 0; game.word[i] != '\0'; i++) {
+                if (game.word[i] == letter) {
+                    game.guess[i] = letter;
+                    hit = 1;
+                }
+            }
+            game.guesses_left -= !hit;
+        }
+    }
+    printf("%d games, %ld boards\n", num_games, calls);
+    printf("best_letter:          %8.1f us\n", solver_ns / calls / 1e3);
+    printf("scan the dictionary:  %8.1f us\n", scan_ns / calls / 1e3);
+    printf("picked different letters on %d boards\n", disagreed);
+    return disagreed != 0;
+}
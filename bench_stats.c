@@ -0,0 +1,139 @@
+/* Benchmark of player statistics with a server's worth of players. Times, per event:
+ *   - what a game thread pays to record a stat
+ *   - what the stats thread spends applying it, for a new player and for a win
+ * then checks that the leaderboard is in order and agrees with the wins recorded, and
+ * times copying the leaderboard message, which every /top does.
+ *
+ * Works on a scratch stats file, bench.stats, which it removes when done.
+ *
+ * Usage: bench_stats [players] [wins]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define SCRATCH_FILE "bench.stats"
+#define MARKER "~marker"   // Not a bench player's name; see wait_for_stats.
+#define COPY_TRIES 100000
+
+struct stats stats;
+int marker_wins = 0;
+
+double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* Return the CPU time the stats thread has used so far.
+ */
+double stats_thread_ns(void) {
+    clockid_t clock;
+    struct timespec t;
+    pthread_getcpuclockid(stats.thread, &clock);
+    clock_gettime(clock, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* Wait until the stats thread has applied every event recorded so far. Events are
+ * applied in order, so give MARKER enough wins to top the leaderboard, more than
+ * most_wins, and wait for the leaderboard to show it.
+ */
+void wait_for_stats(int most_wins) {
+    while (marker_wins <= most_wins) {
+        record_stat(&stats, STAT_WIN, MARKER, 0);
+        marker_wins++;
+    }
+    char want[MAX_MSG];
+    char board[LEADERBOARD_MSG];
+    sprintf(want, " 1. %s: %d wins", MARKER, marker_wins);
+    do {
+        usleep(STATS_INTERVAL / 10);
+        copy_leaderboard(&stats, board);
+    } while (strstr(board, want) == NULL);
+}
+
+int main(int argc, char **argv) {
+    int num_players = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    int num_wins = argc > 2 ? strtol(argv[2], NULL, 10) : 200000;
+    if (num_players < 1 || num_players > STATS_MAX - 1 || num_wins < 0) {
+        fprintf(stderr, "Usage: %s [players, 1 to %d] [wins]\n", argv[0], STATS_MAX - 1);
+        exit(1);
+    }
+    int *wins = calloc(num_players, sizeof(int)); // What each player should have when we're done.
+    if (!wins) {
+        perror("malloc");
+        exit(1);
+    }
+    char name[MAX_NAME];
+
+    unlink(SCRATCH_FILE);
+    start_stats(&stats, SCRATCH_FILE);
+
+    // Everyone plays a game, so the stats thread adds every player.
+    double cpu = stats_thread_ns();
+    double start = now_ns();
+    for (int i = 0; i < num_players; i++) {
+        sprintf(name, "player%d", i);
+        record_stat(&stats, STAT_GAME, name, 0);
+    }
+    double recorded = now_ns() - start;
+    wait_for_stats(0);
+    printf("%d players\n", num_players);
+    printf("record a stat:        %6.0f ns\n", recorded / num_players);
+    printf("apply a new player:   %6.0f ns of stats thread time\n", (stats_thread_ns() - cpu) / num_players);
+
+    // Wins for random players, each of which moves someone up the leaderboard.
+    unsigned seed = 1;
+    int most_wins = 0;
+    cpu = stats_thread_ns();
+    start = now_ns();
+    for (int i = 0; i < num_wins; i++) {
+        int player = rand_r(&seed) % num_players;
+        sprintf(name, "player%d", player);
+        record_stat(&stats, STAT_WIN, name, 0);
+        if (++wins[player] > most_wins) {
+            most_wins = wins[player];
+        }
+    }
+    recorded = now_ns() - start;
+    wait_for_stats(most_wins);
+    if (num_wins > 0) {
+        printf("record a win:         %6.0f ns\n", recorded / num_wins);
+        printf("apply a win:          %6.0f ns of stats thread time\n", (stats_thread_ns() - cpu) / num_wins);
+    }
+
+    // The stats thread has nothing left to do, so we can walk its leaderboard.
+    int ranked = 0;
+    int wrong = 0;
+    struct player_stats *prev = NULL;
+    for (struct rank_node *node = stats.head.next[0]; node != NULL; node = node->next[0]) {
+        struct player_stats *p = &(stats.file->players[node->player]);
+        if (prev != NULL && (prev->wins < p->wins || (prev->wins == p->wins && strcmp(prev->name, p->name) >= 0))) {
+            wrong++;
+        }
+        int player;
+        if (strcmp(p->name, MARKER) != 0 && sscanf(p->name, "player%d", &player) == 1 && p->wins != wins[player]) {
+            wrong++;
+        }
+        prev = p;
+        ranked++;
+    }
+    printf("leaderboard:          %d players ranked, %d out of order or wrong\n", ranked, wrong);
+
+    char board[LEADERBOARD_MSG];
+    start = now_ns();
+    for (int i = 0; i < COPY_TRIES; i++) {
+        copy_leaderboard(&stats, board);
+    }
+    printf("copy the leaderboard: %6.0f ns\n", (now_ns() - start) / COPY_TRIES);
+
+    unlink(SCRATCH_FILE);
+    return wrong != 0 || ranked != num_players + 1;
+}
@@ -24,45 +24,105 @@ char *status_message(char *msg, struct game_state *game) {
     return msg;
 }
 
+/* Return a message with only what changed on the board after letter was guessed:
+ * the letter, the positions (counting from 1) it revealed and the guesses remaining.
+ * For example "> e 2 5 | 3\r\n", or "> x | 2\r\n" for a miss.
+ * Assumes that the caller has allocated MAX_MSG bytes for msg.
+ */
+char *delta_message(char *msg, struct game_state *game, char letter) {
+    int len = sprintf(msg, "> %c", letter);
+    for(int i = 0; game->word[i] != '\0'; i++) {
+        if(game->word[i] == letter) {
+            len += sprintf(msg + len, " %d", i + 1);
+        }
+    }
+    sprintf(msg + len, " | %d\r\n", game->guesses_left);
+    return msg;
+}
+
+/* Serialize the current board once into a new snapshot for spectators, and return
+ * it with one reference, which belongs to the caller. If ending is 1 the game is over,
+ * so the word is shown after the board.
+ */
+struct snapshot *take_snapshot(struct game_state *game, char ending) {
+    struct snapshot *snap = malloc(sizeof(struct snapshot));
+    if (!snap) {
+        perror("malloc");
+        exit(1);
+    }
+    status_message(snap->data, game);
+    snap->len = strlen(snap->data);
+    if (ending) {
+        snap->len += sprintf(snap->data + snap->len, "Game over! The word was %s.\r\n", game->word);
+    }
+    snap->ending = ending;
+    snap->seq = 0;
+    snap->refs = 1;
+    return snap;
+}
+
+/* Drop one reference to snap, freeing it when nobody uses it anymore. */
+void release_snapshot(struct snapshot *snap) {
+    if (snap != NULL && --(snap->refs) == 0) {
+        free(snap);
+    }
+}
+
+
+/* Read the words in the file dict_name, one per line, into dict. Lines that are empty
+ * or too long to be a word are skipped.
+ */
+void load_dictionary(struct dictionary *dict, char *dict_name) {
+    char buf[MAX_MSG];
+    FILE *fp = fopen(dict_name, "r");
+    if(fp == NULL) {
+        perror("Opening dictionary");
+        exit(1);
+    }
+
+    int capacity = 1024;
+    dict->words = malloc(capacity * MAX_WORD);
+    dict->size = 0;
+    if(!dict->words) {
+        perror("malloc");
+        exit(1);
+    }
+    while(fgets(buf, MAX_MSG, fp) != NULL) {
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if(buf[0] == '\0' || strlen(buf) >= MAX_WORD) {
+            continue;
+        }
+        if(dict->size == capacity) {
+            capacity *= 2;
+            dict->words = realloc(dict->words, capacity * MAX_WORD);
+            if(!dict->words) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        strcpy(dict->words[dict->size++], buf); // Safe, we checked buf fits.
+    }
+    fclose(fp);
+
+    if(dict->size == 0) {
+        fprintf(stderr, "There are no words in %s\n", dict_name);
+        exit(1);
+    }
+}
+
 
 /* Initialize the gameboard: 
- *    - initialize dictionary
- *    - select a random word to guess from the dictionary file
+ *    - select a random word to guess from game->dict
  *    - set guess to all dashes ('-')
  *    - initialize the other fields
  * We can't initialize head and has_next_turn because these will have
  * different values when we use init_game to create a new game after one
  * has already been played
  */
-void init_game(struct game_state *game, char *dict_name) {
-    char buf[MAX_WORD];
-    if(game->dict.fp != NULL) {
-        rewind(game->dict.fp);
-    } else {
-        game->dict.fp = fopen(dict_name, "r");
-        if(game->dict.fp == NULL) {
-            perror("Opening dictionary");
-            exit(1);
-        }
-    } 
-
-    int index = random() % game->dict.size;
+void init_game(struct game_state *game) {
+    int index = random() % game->dict->size;
     printf("Looking for word at index %d\n", index);
-    for(int i = 0; i <= index; i++) {
-        if(!fgets(buf, MAX_WORD, game->dict.fp)){
-            fprintf(stderr,"File ended before we found the entry index %d",index);
-            exit(1);
-        }
-    } 
-
-    // Found word
-    if(buf[strlen(buf) - 1] == '\n') {  // from a unix file
-        buf[strlen(buf) - 1] = '\0';
-    } else {
-        fprintf(stderr, "The dictionary file does not appear to have Unix line endings\n");
-    }
-    strncpy(game->word, buf, MAX_WORD);
-    game->word[MAX_WORD-1] = '\0';
+    strcpy(game->word, game->dict->words[index]); // Safe, load_dictionary only keeps words that fit.
     for(int j = 0; j < strlen(game->word); j++) {
         game->guess[j] = '-';
     }
@@ -74,23 +134,3 @@ void init_game(struct game_state *game, char *dict_name) {
     game->guesses_left = MAX_GUESSES;
 
 }
-
-
-/* Return the number of lines in the file
- */
-int get_file_length(char *filename) {
-    char buf[MAX_MSG];
-    int count = 0;
-    FILE *fp;
-    if((fp = fopen(filename, "r")) == NULL) {
-        perror("open");
-        exit(1);
-    }
-    
-    while(fgets(buf, MAX_MSG, fp) != NULL) {
-        count++;
-    }
-    
-    fclose(fp);
-    return count;
-}
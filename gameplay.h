@@ -1,4 +1,8 @@
+#ifndef _GAMEPLAY_H_
+#define _GAMEPLAY_H_
+
 #include <netinet/in.h>
+#include <time.h>
 
 #define MAX_NAME 30  
 #define MAX_MSG 128
@@ -12,14 +16,36 @@ struct client {
     int fd;
     struct in_addr ipaddr;
     struct client *next;
-    char name[MAX_NAME];
+    const char *name;     // Interned in the name registry once the client has a name, "" until then. Bots own theirs.
     char inbuf[MAX_BUF];  // Used to hold input from the client
     char *in_ptr;         // A pointer into inbuf to help with partial reads. points to first unwritten element.
+    struct snapshot *snap; // Spectators only: the board being (or last) written to this client.
+    int snap_off;          // Spectators only: number of bytes of snap already written.
+    struct audience *watching; // Spectators only: the room being watched.
+    char delta;            // 1 if the client wants delta board updates instead of the full board.
+    time_t joined;         // When the client entered the lobby.
+    char bot;              // 1 if the client is a bot played by the server. Bots have a negative fd.
+};
+
+/* A serialized copy of the board that is shared by every spectator of a game.
+ * The worker running the game makes one whenever the board changes, and one of the
+ * final board when a game ends, and hands it to the spectator thread, which from then
+ * on is the only thread to touch it. The room's audience holds a reference to the
+ * board it is sending and each spectator holds one to the snapshot it is being sent,
+ * so a snapshot is freed once the game has moved on and no spectator is still in the
+ * middle of writing it.
+ */
+struct snapshot {
+    int refs;
+    int len;
+    int seq;               // Set by the spectator thread when it is first sent, counting up in each room.
+    char ending;           // 1 if this is the final board of a game, which spectators never skip.
+    char data[2 * MAX_MSG]; // The board, then for an ending the word.
 };
 
-// Information about the dictionary used to pick random word
+// The words games pick from. Read into memory once and shared by every room.
 struct dictionary {
-    FILE *fp;
+    char (*words)[MAX_WORD];
     int size;
 };
 
@@ -29,13 +55,21 @@ struct game_state {
     int letters_guessed[NUM_LETTERS]; // Index i will be 1 if the corresponding
                                       // letter has been guessed; 0 otherwise
     int guesses_left;         // Number of guesses remaining
-    struct dictionary dict;
+    struct dictionary *dict;
     
     struct client *head;
     struct client *has_next_turn;
+
+    int id;                    // Each game is played in its own room, numbered from 0.
+    struct game_state *next;   // The next room owned by the same worker thread.
 };
 
 
-void init_game(struct game_state *game, char *dict_name);
-int get_file_length(char *filename);
-char *status_message(char *msg, struct game_state *game);
\ No newline at end of file
+void load_dictionary(struct dictionary *dict, char *dict_name);
+void init_game(struct game_state *game);
+char *status_message(char *msg, struct game_state *game);
+char *delta_message(char *msg, struct game_state *game, char letter);
+struct snapshot *take_snapshot(struct game_state *game, char ending);
+void release_snapshot(struct snapshot *snap);
+
+#endif
@@ -0,0 +1,11 @@
+#include "hash.h"
+
+/* Return the FNV-1a hash of name. Used by every table keyed by player name.
+ */
+unsigned hash_name(const char *name) {
+    unsigned hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,6 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+unsigned hash_name(const char *name);
+
+#endif
@@ -0,0 +1,30 @@
+#include <stddef.h>
+
+#include "queue.h"
+
+/* Push node onto q. Safe to call from any number of threads at once.
+ */
+void mpsc_push(struct mpsc_queue *q, struct mpsc_node *node) {
+    struct mpsc_node *top = __atomic_load_n(&(q->top), __ATOMIC_RELAXED);
+    do {
+        node->next = top;
+    } while (!__atomic_compare_exchange_n(&(q->top), &top, node, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Take every node pushed onto q so far and return them as a list, oldest first,
+ * or NULL if q is empty. Only one thread may take from a given queue. Since it
+ * always empties the whole queue, a node can't be reused under a pusher's feet.
+ */
+struct mpsc_node *mpsc_take_all(struct mpsc_queue *q) {
+    struct mpsc_node *top = __atomic_exchange_n(&(q->top), NULL, __ATOMIC_ACQUIRE);
+
+    // Nodes were pushed on top of each other, so reverse the list to get them oldest first.
+    struct mpsc_node *list = NULL;
+    while (top != NULL) {
+        struct mpsc_node *next = top->next;
+        top->next = list;
+        list = top;
+        top = next;
+    }
+    return list;
+}
@@ -0,0 +1,19 @@
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+
+/* A lock-free queue that any number of threads can push to and a single thread
+ * takes from. Embed a struct mpsc_node as the first member of whatever is queued
+ * and cast back to it after taking.
+ */
+struct mpsc_node {
+    struct mpsc_node *next;
+};
+
+struct mpsc_queue {
+    struct mpsc_node *top; // The most recently pushed node, or NULL if empty.
+};
+
+void mpsc_push(struct mpsc_queue *q, struct mpsc_node *node);
+struct mpsc_node *mpsc_take_all(struct mpsc_queue *q);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "registry.h"
+#include "hash.h"
+
+/* Initialize reg with size slots. size must be a power of 2.
+ */
+void init_registry(struct registry *reg, int size) {
+    int num_entries = size / 4 * 3;
+    reg->slots = malloc(size * sizeof(struct registry_slot));
+    reg->entries = malloc(num_entries * sizeof(struct registry_entry));
+    if (!reg->slots || !reg->entries) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < size; i++) {
+        reg->slots[i].entry = NO_ENTRY;
+    }
+    for (int i = 0; i < num_entries; i++) {
+        reg->entries[i].next_free = i + 1 < num_entries ? i + 1 : NO_ENTRY;
+    }
+    reg->size = size;
+    reg->free_entry = 0;
+    init_seqlock(&(reg->seq));
+    if ((errno = pthread_mutex_init(&(reg->lock), NULL)) != 0) {
+        perror("pthread_mutex_init");
+        exit(1);
+    }
+}
+
+/* Return the slot holding name in reg, or the empty slot that ends its probe if
+ * name isn't there. hash is the hash of name.
+ */
+struct registry_slot *find_slot(struct registry *reg, const char *name, unsigned hash) {
+    unsigned mask = reg->size - 1;
+    unsigned i = hash & mask;
+    // The table is never full, so the probe always reaches an empty slot.
+    while (reg->slots[i].entry != NO_ENTRY) {
+        struct registry_slot *slot = &(reg->slots[i]);
+        if (slot->hash == hash && strncmp(reg->entries[slot->entry].name, name, MAX_NAME) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &(reg->slots[i]);
+}
+
+/* Return 1 if name is reserved in reg, 0 otherwise. Does not lock, so any thread
+ * can call it at any time. If reg changes while we look, we look again.
+ */
+int name_in_use(struct registry *reg, const char *name) {
+    unsigned hash = hash_name(name);
+    unsigned seq;
+    int found;
+    do {
+        seq = seqlock_begin_read(&(reg->seq));
+        found = find_slot(reg, name, hash)->entry != NO_ENTRY;
+    } while (seqlock_read_again(&(reg->seq), seq));
+    return found;
+}
+
+/* Reserve name in reg and return NAME_RESERVED, setting *interned to the interned
+ * copy of the name, which stays valid until it is passed to release_name. Return
+ * NAME_TAKEN if the name is already in use, or REGISTRY_FULL if reg has no room for
+ * another name.
+ */
+int reserve_name(struct registry *reg, const char *name, const char **interned) {
+    if (name_in_use(reg, name)) { // Most taken names are turned away here without locking.
+        return NAME_TAKEN;
+    }
+
+    pthread_mutex_lock(&(reg->lock));
+    unsigned hash = hash_name(name);
+    struct registry_slot *slot = find_slot(reg, name, hash);
+    if (slot->entry != NO_ENTRY) { // Someone reserved it since we checked.
+        pthread_mutex_unlock(&(reg->lock));
+        return NAME_TAKEN;
+    }
+    if (reg->free_entry == NO_ENTRY) {
+        fprintf(stderr, "Name registry is full, could not reserve %s\n", name);
+        pthread_mutex_unlock(&(reg->lock));
+        return REGISTRY_FULL;
+    }
+
+    seqlock_begin_write(&(reg->seq)); // We hold the lock, so we are the only writer.
+    int e = reg->free_entry;
+    reg->free_entry = reg->entries[e].next_free;
+    strncpy(reg->entries[e].name, name, MAX_NAME);
+    reg->entries[e].name[MAX_NAME - 1] = '\0';
+    slot->hash = hash;
+    slot->entry = e;
+    seqlock_end_write(&(reg->seq));
+
+    pthread_mutex_unlock(&(reg->lock));
+    *interned = reg->entries[e].name;
+    return NAME_RESERVED;
+}
+
+/* Release name, which must have been returned by reserve_name on reg, so that
+ * someone else can use it.
+ */
+void release_name(struct registry *reg, const char *name) {
+    // The interned name is the entry, so we know which entry to free without comparing names.
+    int e = (struct registry_entry *)name - reg->entries;
+    unsigned mask = reg->size - 1;
+
+    pthread_mutex_lock(&(reg->lock));
+    unsigned i = hash_name(name) & mask;
+    while (reg->slots[i].entry != e) {
+        i = (i + 1) & mask;
+    }
+
+    seqlock_begin_write(&(reg->seq));
+    /* Empty the slot, then move back any later names in the run whose probe would
+     * otherwise hit the hole before reaching them. This keeps probes short without
+     * leaving markers behind for deleted names.
+     */
+    unsigned hole = i;
+    for (unsigned j = (i + 1) & mask; reg->slots[j].entry != NO_ENTRY; j = (j + 1) & mask) {
+        unsigned home = reg->slots[j].hash & mask;
+        // Move the name in j back if its home slot is not in the cyclic range (hole, j].
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            reg->slots[hole] = reg->slots[j];
+            hole = j;
+        }
+    }
+    reg->slots[hole].entry = NO_ENTRY;
+    reg->entries[e].next_free = reg->free_entry;
+    reg->free_entry = e;
+    seqlock_end_write(&(reg->seq));
+
+    pthread_mutex_unlock(&(reg->lock));
+}
@@ -0,0 +1,49 @@
+#ifndef _REGISTRY_H_
+#define _REGISTRY_H_
+
+#include <pthread.h>
+
+#include "gameplay.h"
+#include "seqlock.h"
+
+#define REGISTRY_SIZE (1 << 18) // Slots in the name registry. Must be a power of 2.
+#define NO_ENTRY -1             // Marks an empty slot.
+
+// What reserve_name returns.
+#define NAME_RESERVED 0         // The name is now the caller's.
+#define NAME_TAKEN 1            // Someone else has the name.
+#define REGISTRY_FULL 2         // No more names fit, whatever they are.
+
+/* An interned name. Clients point to the name for as long as they hold it.
+ */
+struct registry_entry {
+    char name[MAX_NAME];
+    int next_free;        // The next unused entry, while this one is unused.
+};
+
+/* One slot of the open addressing (linear probing) table of names in use.
+ */
+struct registry_slot {
+    unsigned hash;
+    int entry;            // Index into entries, or NO_ENTRY.
+};
+
+/* The names in use on the whole server. Any thread may look a name up without
+ * locking. Reserving and releasing names take the lock, and bump seq around
+ * every change so that lookups which overlap a change know to try again.
+ */
+struct registry {
+    struct registry_slot *slots;
+    int size;             // Number of slots, a power of 2.
+    struct registry_entry *entries; // size / 4 * 3 of them, so the table is never more than 3/4 full.
+    int free_entry;       // Head of the list of unused entries, or NO_ENTRY if all are in use.
+    struct seqlock seq;   // Moves on every change to the table.
+    pthread_mutex_t lock;
+};
+
+void init_registry(struct registry *reg, int size);
+int name_in_use(struct registry *reg, const char *name);
+int reserve_name(struct registry *reg, const char *name, const char **interned);
+void release_name(struct registry *reg, const char *name);
+
+#endif
@@ -0,0 +1,34 @@
+#include "seqlock.h"
+
+void init_seqlock(struct seqlock *sl) {
+    sl->seq = 0;
+}
+
+/* Mark the start of a change. Readers that start before seqlock_end_write will
+ * read again.
+ */
+void seqlock_begin_write(struct seqlock *sl) {
+    __atomic_store_n(&(sl->seq), sl->seq + 1, __ATOMIC_RELAXED); // Odd: readers retry.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void seqlock_end_write(struct seqlock *sl) {
+    __atomic_store_n(&(sl->seq), sl->seq + 1, __ATOMIC_RELEASE); // Even: stable again.
+}
+
+/* Wait out any change in progress and return the count to pass to
+ * seqlock_read_again once the data has been read.
+ */
+unsigned seqlock_begin_read(struct seqlock *sl) {
+    unsigned seq;
+    while ((seq = __atomic_load_n(&(sl->seq), __ATOMIC_ACQUIRE)) & 1);
+    return seq;
+}
+
+/* Return 1 if the data changed since the seqlock_begin_read that returned seq,
+ * so what was read may be torn and must be read again, 0 if it is good.
+ */
+int seqlock_read_again(struct seqlock *sl, unsigned seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return seq != __atomic_load_n(&(sl->seq), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,19 @@
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+/* A sequence count that lets any number of threads read shared data without
+ * locking while one thread at a time changes it. A reader that overlaps a change
+ * sees the count move and reads again. Writers must keep each other out by some
+ * other means, such as a mutex or there being only one of them.
+ */
+struct seqlock {
+    unsigned seq; // Even while the data is stable, odd while it is being changed.
+};
+
+void init_seqlock(struct seqlock *sl);
+void seqlock_begin_write(struct seqlock *sl);
+void seqlock_end_write(struct seqlock *sl);
+unsigned seqlock_begin_read(struct seqlock *sl);
+int seqlock_read_again(struct seqlock *sl, unsigned seq);
+
+#endif
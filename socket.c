@@ -5,6 +5,7 @@
 #include <arpa/inet.h>     /* inet_ntoa */
 #include <netdb.h>         /* gethostname */
 #include <sys/socket.h>
+#include <netinet/tcp.h>   /* TCP_NODELAY */
 
 #include "socket.h"
 
@@ -70,7 +71,7 @@ int set_up_server_socket(struct sockaddr_in *self, int num_queue) {
 
 /*
  * Wait for and accept a new connection.
- * Terminate with exit code 1 if the accept call failed, otherwise return
+ * Return -1 if the accept call failed, with errno set, otherwise return
  * the client's socket descriptor.
  */
 int accept_connection(int listenfd) {
@@ -82,11 +83,16 @@ int accept_connection(int listenfd) {
     int client_socket = accept(listenfd, (struct sockaddr *)&peer, &peer_len);
     if (client_socket < 0) {
         perror("accept");
-        exit(1);
+        return -1;
     } else {
         printf("New connection accepted from %s:%d\n",
             inet_ntoa(peer.sin_addr),
             ntohs(peer.sin_port));
+        // A turn is several small writes, so don't let Nagle hold the last ones back.
+        int on = 1;
+        if (setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+            perror("setsockopt");
+        }
         return client_socket;
     }
 }
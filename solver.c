@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "solver.h"
+
+/* Return the bitset of the words in g with letter c at position i.
+ */
+uint64_t *at_bits(struct word_group *g, int i, int c) {
+    return g->bits + ((size_t)i * NUM_LETTERS + c) * g->blocks;
+}
+
+/* Return the bitset of the words in g with letter c anywhere. These come after the
+ * at_bits of every position.
+ */
+uint64_t *has_bits(struct word_group *g, int len, int c) {
+    return at_bits(g, len, c);
+}
+
+/* Return the length of word, or -1 if it isn't a word the solver can handle (not all
+ * lowercase letters).
+ */
+int word_length(const char *word) {
+    int len = strlen(word);
+    for (int i = 0; i < len; i++) {
+        if (word[i] < 'a' || word[i] > 'z') {
+            return -1;
+        }
+    }
+    return len;
+}
+
+/* Build the solver index over the words in dict.
+ */
+void init_solver(struct solver *solver, struct dictionary *dict) {
+    // First pass: count the words of each length so we can size the bitsets.
+    memset(solver, 0, sizeof(struct solver));
+    int len;
+    for (int i = 0; i < dict->size; i++) {
+        if ((len = word_length(dict->words[i])) != -1) {
+            solver->groups[len].count++;
+        }
+    }
+    for (len = 1; len < MAX_WORD; len++) {
+        struct word_group *g = &(solver->groups[len]);
+        g->blocks = (g->count + 63) / 64;
+        // One bitset for each letter at each position, and one for each letter anywhere.
+        g->bits = calloc((size_t)(len + 1) * NUM_LETTERS * g->blocks, sizeof(uint64_t));
+        if (g->blocks > 0 && !g->bits) {
+            perror("calloc");
+            exit(1);
+        }
+        g->count = 0; // Counted again as the words are added.
+    }
+
+    // Second pass: set the bits of every word.
+    for (int i = 0; i < dict->size; i++) {
+        char *word = dict->words[i];
+        if ((len = word_length(word)) == -1) {
+            continue;
+        }
+        struct word_group *g = &(solver->groups[len]);
+        int w = g->count++;
+        uint64_t bit = (uint64_t)1 << (w % 64);
+        for (int j = 0; j < len; j++) {
+            int c = word[j] - 'a';
+            at_bits(g, j, c)[w / 64] |= bit;
+            has_bits(g, len, c)[w / 64] |= bit;
+        }
+    }
+}
+
+/* Return the unguessed letter that appears in the most dictionary words that still
+ * fit game's board, or '\0' if there are none. A word fits if it has the revealed
+ * letters in their places, and no guessed letter anywhere else (a guessed letter
+ * that is in the word is revealed everywhere it appears).
+ */
+char best_letter(struct solver *solver, struct game_state *game) {
+    int len = strlen(game->guess);
+    struct word_group *g = &(solver->groups[len]);
+    if (g->count == 0) {
+        return '\0';
+    }
+
+    // Start with every word of the right length, then AND away the ones that don't fit.
+    uint64_t fits[g->blocks];
+    memset(fits, 0xff, sizeof(fits));
+    if (g->count % 64 != 0) {
+        fits[g->blocks - 1] = ((uint64_t)1 << (g->count % 64)) - 1;
+    }
+
+    int revealed[NUM_LETTERS] = {0};
+    for (int i = 0; i < len; i++) {
+        if (game->guess[i] != '-') {
+            int c = game->guess[i] - 'a';
+            revealed[c] = 1;
+            uint64_t *at = at_bits(g, i, c);
+            for (int b = 0; b < g->blocks; b++) {
+                fits[b] &= at[b];
+            }
+        }
+    }
+    for (int c = 0; c < NUM_LETTERS; c++) {
+        if (!game->letters_guessed[c]) {
+            continue;
+        }
+        if (!revealed[c]) { // A miss, so no fitting word has it anywhere.
+            uint64_t *has = has_bits(g, len, c);
+            for (int b = 0; b < g->blocks; b++) {
+                fits[b] &= ~has[b];
+            }
+        } else { // A hit, so no fitting word has it where the board is still hidden.
+            for (int i = 0; i < len; i++) {
+                if (game->guess[i] == '-') {
+                    uint64_t *at = at_bits(g, i, c);
+                    for (int b = 0; b < g->blocks; b++) {
+                        fits[b] &= ~at[b];
+                    }
+                }
+            }
+        }
+    }
+
+    // Count how many fitting words have each unguessed letter.
+    char best = '\0';
+    int best_count = 0;
+    for (int c = 0; c < NUM_LETTERS; c++) {
+        if (game->letters_guessed[c]) {
+            continue;
+        }
+        uint64_t *has = has_bits(g, len, c);
+        int count = 0;
+        for (int b = 0; b < g->blocks; b++) {
+            count += __builtin_popcountll(fits[b] & has[b]);
+        }
+        if (count > best_count) {
+            best_count = count;
+            best = 'a' + c;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,28 @@
+#ifndef _SOLVER_H_
+#define _SOLVER_H_
+
+#include <stdint.h>
+
+#include "gameplay.h"
+
+/* Every dictionary word of one length, stored column-wise as bitsets: bit w of a
+ * bitset stands for word w of the group. A bitset is blocks 64 bit words long.
+ */
+struct word_group {
+    int count;            // Number of words.
+    int blocks;
+    uint64_t *bits;       // The group's bitsets, see at_bits and has_bits.
+};
+
+/* An index over the dictionary that finds the words matching a board quickly, by
+ * ANDing bitsets together instead of comparing words. Read only once built, so any
+ * number of threads can use it at once.
+ */
+struct solver {
+    struct word_group groups[MAX_WORD]; // groups[n] holds the words of length n.
+};
+
+void init_solver(struct solver *solver, struct dictionary *dict);
+char best_letter(struct solver *solver, struct game_state *game);
+
+#endif
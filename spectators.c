@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#include "spectators.h"
+
+#define MAX_READY 256 // Most sockets handled per epoll_wait.
+
+void *run_spectators(void *arg);
+
+/* Return the time in microseconds on a clock that only moves forward. */
+long long now_us(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
+/* Set up s and start the spectator thread.
+ */
+void start_spectators(struct spectators *s) {
+    if (pipe(s->wake_fd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    // Producers must never wait on the spectator thread, and it drains the pipe until it
+    // is empty, so neither end may block.
+    for (int end = 0; end < 2; end++) {
+        int flags = fcntl(s->wake_fd[end], F_GETFL);
+        if (flags == -1 || fcntl(s->wake_fd[end], F_SETFL, flags | O_NONBLOCK) == -1) {
+            perror("fcntl");
+            exit(1);
+        }
+    }
+    if ((s->epoll_fd = epoll_create1(0)) == -1) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    struct epoll_event ev = {EPOLLIN, {.ptr = NULL}}; // NULL marks the wake pipe.
+    if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->wake_fd[0], &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    s->events.top = NULL;
+    s->notified = 0;
+    s->rooms = NULL;
+    if ((errno = pthread_create(&(s->thread), NULL, run_spectators, s)) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+}
+
+/* Tell the spectator thread about room room_id. See struct spectator_event for what
+ * snap and p are for each kind of event. Safe to call from any thread.
+ */
+void tell_spectators(struct spectators *s, int kind, int room_id, struct snapshot *snap, struct client *p) {
+    struct spectator_event *event = malloc(sizeof(struct spectator_event));
+    if (!event) {
+        perror("malloc");
+        exit(1);
+    }
+    event->kind = kind;
+    event->room_id = room_id;
+    event->snap = snap;
+    event->client = p;
+    mpsc_push(&(s->events), &(event->node));
+
+    // A board per guess would otherwise mean a write and a wake up per guess. See run_spectators.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_exchange_n(&(s->notified), 1, __ATOMIC_SEQ_CST)) {
+        char wake = 0;
+        if (write(s->wake_fd[1], &wake, 1) == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("write");
+            exit(1);
+        }
+    }
+}
+
+/* Return the audience of room room_id, or NULL if we don't know of it.
+ */
+struct audience *find_audience(struct spectators *s, int room_id) {
+    struct audience *a;
+    for (a = s->rooms; a != NULL && a->id != room_id; a = a->next);
+    return a;
+}
+
+/* Close spectator p's socket and forget it.
+ */
+void drop_spectator(struct spectators *s, struct client *p) {
+    struct client **at;
+    for (at = &((p->watching)->spectators); *at != p; at = &(*at)->next);
+    *at = p->next;
+    close(p->fd); // Also takes it out of epoll_fd.
+    release_snapshot(p->snap);
+    free(p);
+}
+
+/* Write spectator p as much of its room's board as its socket will take. A spectator
+ * that can't keep up finishes the board it is part way through and then skips straight
+ * to the latest one, rather than queuing every board in between. It is still sent the
+ * end of a game it skipped past, so it finds out what the word was. Return -1 if p
+ * disconnected and has been dropped, 0 otherwise.
+ */
+int write_spectator(struct spectators *s, struct client *p) {
+    struct audience *a = p->watching;
+    while (p->snap != a->board || (p->snap != NULL && p->snap_off < (p->snap)->len)) {
+        if (p->snap == NULL || p->snap_off == (p->snap)->len) { // Done with the last one, move to the latest.
+            struct snapshot *next = a->board;
+            if (p->snap != NULL && a->ending != NULL && (p->snap)->seq < (a->ending)->seq) {
+                next = a->ending;
+            }
+            release_snapshot(p->snap);
+            p->snap = next;
+            (p->snap)->refs++;
+            p->snap_off = 0;
+        }
+        int n = write(p->fd, (p->snap)->data + p->snap_off, (p->snap)->len - p->snap_off);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { // epoll tells us when there is room.
+                return 0;
+            }
+            printf("[%d] spectator left.\n", p->fd);
+            drop_spectator(s, p);
+            return -1;
+        }
+        p->snap_off += n;
+    }
+    return 0;
+}
+
+/* Start sending a's newest board to all of a's spectators, or the end of the game
+ * before it if that hasn't been sent yet. The board is serialized once, by the worker,
+ * however many are watching.
+ */
+void show_board(struct spectators *s, struct audience *a) {
+    release_snapshot(a->board);
+    if (a->ending_due != NULL) {
+        a->board = a->ending_due;
+        a->ending_due = NULL;
+    } else {
+        a->board = a->newest;
+        a->newest = NULL;
+    }
+    (a->board)->seq = ++(a->shown);
+    if ((a->board)->ending) {
+        release_snapshot(a->ending);
+        a->ending = a->board;
+        (a->ending)->refs++;
+    }
+    a->sent_at = now_us();
+    struct client *p = a->spectators;
+    while (p != NULL) {
+        struct client *temp = p->next; // Do first in case we drop p
+        write_spectator(s, p);
+        p = temp;
+    }
+}
+
+/* Add client p as a spectator of room room_id. Spectators never take a turn and are only
+ * sent the board. Their socket is made non-blocking so a slow spectator can never stall
+ * the others.
+ */
+void add_spectator(struct spectators *s, int room_id, struct client *p) {
+    struct audience *a = find_audience(s, room_id);
+    if (a == NULL) { // Everyone left before the spectator got here.
+        printf("[%d] tried to watch game %d, which has closed.\n", p->fd, room_id);
+        if (write(p->fd, CLOSED_MSG, strlen(CLOSED_MSG)) == -1) {
+            perror("write");
+        }
+        close(p->fd);
+        free(p);
+        return;
+    }
+    p->watching = a;
+    p->snap = NULL;
+    p->snap_off = 0;
+    p->next = a->spectators;
+    a->spectators = p;
+
+    // Edge triggered, so we are told once each time the socket has room again, not every pass.
+    int flags = fcntl(p->fd, F_GETFL);
+    struct epoll_event ev = {EPOLLIN | EPOLLOUT | EPOLLET, {.ptr = p}};
+    if (flags == -1 || fcntl(p->fd, F_SETFL, flags | O_NONBLOCK) == -1
+            || epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, p->fd, &ev) == -1) {
+        perror("add_spectator");
+        drop_spectator(s, p);
+        return;
+    }
+    printf("[%d] is now watching game %d.\n", p->fd, room_id);
+    // The socket starts out writable, so epoll will have us send it the board.
+}
+
+/* Send room_id's spectators away and forget the room.
+ */
+void close_audience(struct spectators *s, int room_id) {
+    struct audience **at;
+    for (at = &(s->rooms); *at != NULL && (*at)->id != room_id; at = &(*at)->next);
+    if (*at == NULL) {
+        return;
+    }
+    struct audience *a = *at;
+    *at = a->next;
+    while (a->spectators != NULL) {
+        struct client *p = a->spectators;
+        if (write(p->fd, CLOSED_MSG, strlen(CLOSED_MSG)) == -1 && errno != EAGAIN) {
+            perror("write");
+        }
+        drop_spectator(s, p);
+    }
+    release_snapshot(a->board);
+    release_snapshot(a->newest);
+    release_snapshot(a->ending_due);
+    release_snapshot(a->ending);
+    free(a);
+}
+
+/* Carry out every event pushed to s so far.
+ */
+void take_events(struct spectators *s) {
+    struct mpsc_node *node = mpsc_take_all(&(s->events));
+    while (node != NULL) {
+        struct spectator_event *event = (struct spectator_event *)node;
+        node = node->next;
+        struct audience *a;
+        if (event->kind == SPECTATE_OPEN) {
+            a = calloc(1, sizeof(struct audience));
+            if (!a) {
+                perror("calloc");
+                exit(1);
+            }
+            a->id = event->room_id;
+            a->next = s->rooms;
+            s->rooms = a;
+        } else if (event->kind == SPECTATE_BOARD) {
+            if ((a = find_audience(s, event->room_id)) != NULL) {
+                if (a->newest != NULL && (a->newest)->ending) { // Only a later end of a game replaces it.
+                    release_snapshot(a->ending_due);
+                    a->ending_due = a->newest;
+                } else {
+                    release_snapshot(a->newest); // Nobody has seen it, and now nobody needs to.
+                }
+                a->newest = event->snap;
+            } else {
+                release_snapshot(event->snap);
+            }
+        } else if (event->kind == SPECTATE_CLOSE) {
+            close_audience(s, event->room_id);
+        } else {
+            add_spectator(s, event->room_id, event->client);
+        }
+        free(event);
+    }
+}
+
+/* The body of the spectator thread. Takes events from the main thread and workers and
+ * writes boards to spectators as their sockets have room. Each room's spectators are
+ * sent a new board at most every SPECTATOR_INTERVAL, so a room playing fast costs the
+ * same number of writes as a slow one, however big its crowd.
+ */
+void *run_spectators(void *arg) {
+    struct spectators *s = arg;
+    struct epoll_event ready[MAX_READY];
+
+    while (1) {
+        take_events(s);
+
+        // Send the boards that are due, and work out when the next one is.
+        long long wait = -1; // Microseconds, or -1 to wait until we are told something.
+        long long now = now_us();
+        for (struct audience *a = s->rooms; a != NULL; a = a->next) {
+            if (a->newest == NULL) {
+                continue;
+            }
+            long long due = a->sent_at + SPECTATOR_INTERVAL - now;
+            if (due <= 0) {
+                show_board(s, a);
+            } else if (wait == -1 || due < wait) {
+                wait = due;
+            }
+        }
+
+        /* While a board is due we wake up in time for it anyway and take any events then,
+         * so producers needn't wake us, and leave notified set. Once nothing is due, clear it
+         * so the next event does wake us. Check for events pushed before we cleared it, since
+         * their producers saw it set and didn't write to the pipe.
+         */
+        if (wait == -1) {
+            __atomic_store_n(&(s->notified), 0, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&(s->events.top), __ATOMIC_RELAXED) != NULL) {
+                continue;
+            }
+        }
+
+        int n = epoll_wait(s->epoll_fd, ready, MAX_READY, wait == -1 ? -1 : (wait + 999) / 1000);
+        if (n == -1) {
+            if (errno != EINTR) {
+                perror("epoll_wait");
+            }
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            struct client *p = ready[i].data.ptr;
+            if (p == NULL) { // The wake pipe, the events are taken at the top of the loop.
+                char buf[64];
+                while (read(s->wake_fd[0], buf, sizeof(buf)) > 0);
+                continue;
+            }
+            if (ready[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                // Spectators' input is ignored, but we need to notice them leaving.
+                char buf[MAX_BUF];
+                int num_read;
+                while ((num_read = read(p->fd, buf, sizeof(buf))) > 0);
+                if (num_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    printf("[%d] spectator left.\n", p->fd);
+                    drop_spectator(s, p);
+                    continue;
+                }
+            }
+            if (ready[i].events & EPOLLOUT) {
+                write_spectator(s, p);
+            }
+        }
+    }
+    return NULL;
+}
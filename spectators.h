@@ -0,0 +1,58 @@
+#ifndef _SPECTATORS_H_
+#define _SPECTATORS_H_
+
+#include <pthread.h>
+
+#include "gameplay.h"
+#include "queue.h"
+
+#define SPECTATOR_INTERVAL 50000 // Min microseconds between boards sent to a room's spectators.
+#define CLOSED_MSG "Everyone has left the game. Goodbye.\r\n"
+
+// What the main thread and workers tell the spectator thread, see tell_spectators.
+#define SPECTATE_OPEN 0  // A room has started.
+#define SPECTATE_BOARD 1 // A room's board has changed.
+#define SPECTATE_CLOSE 2 // A room has closed.
+#define SPECTATE_WATCH 3 // A client wants to watch a room.
+
+struct spectator_event {
+    struct mpsc_node node;  // Must be first, we cast the queue node back to the event.
+    int kind;
+    int room_id;
+    struct snapshot *snap;  // SPECTATE_BOARD: the new board. The spectator thread takes over the reference.
+    struct client *client;  // SPECTATE_WATCH: the client, which the spectator thread takes over.
+};
+
+/* The spectators of one room, as the spectator thread sees it. The room itself
+ * belongs to a worker, which only sends us its boards.
+ */
+struct audience {
+    int id;                   // The room's id.
+    struct client *spectators;
+    struct snapshot *board;   // The board spectators are being sent, NULL until the first arrives.
+    struct snapshot *newest;  // A newer board waiting its turn to be sent, or NULL.
+    struct snapshot *ending_due; // The end of a game newest came after, sent before it, or NULL.
+    struct snapshot *ending;  // The last game over board sent, or NULL. See write_spectator.
+    int shown;                // How many boards have been sent, the seq of board.
+    long long sent_at;        // When board started being sent, in microseconds (see now_us).
+    struct audience *next;
+};
+
+/* Spectators are served by a thread of their own, so however many there are they never
+ * hold up a worker: the workers and the main thread only push events, and the spectator
+ * thread owns every audience and every spectator's socket.
+ */
+struct spectators {
+    struct mpsc_queue events;
+    int wake_fd[2];           // Pipe written to after pushing an event, unless notified is set.
+    int notified;             // 1 if the spectator thread will look at events without being woken.
+    int epoll_fd;             // Every spectator's socket, and the read end of wake_fd.
+    struct audience *rooms;
+    pthread_t thread;
+};
+
+long long now_us(void);
+void start_spectators(struct spectators *s);
+void tell_spectators(struct spectators *s, int kind, int room_id, struct snapshot *snap, struct client *p);
+
+#endif
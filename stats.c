@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "stats.h"
+#include "hash.h"
+
+void *run_stats(void *arg);
+
+/* Return 1 if player a ranks ahead of player b on the leaderboard: more wins
+ * first, and alphabetically between players with the same number of wins.
+ */
+int ranks_before(struct stats *stats, int a, int b) {
+    struct player_stats *pa = &(stats->file->players[a]);
+    struct player_stats *pb = &(stats->file->players[b]);
+    if (pa->wins != pb->wins) {
+        return pa->wins > pb->wins;
+    }
+    return strcmp(pa->name, pb->name) < 0;
+}
+
+/* Put player on the leaderboard in its place. Takes O(log n) time on average.
+ */
+void rank_player(struct stats *stats, int player) {
+    struct rank_node *node = stats->ranks[player];
+    if (node == NULL) {
+        node = malloc(sizeof(struct rank_node));
+        if (!node) {
+            perror("malloc");
+            exit(1);
+        }
+        node->player = player;
+        stats->ranks[player] = node;
+    }
+
+    // Each node is on the level below and, half the time, on the next level up too.
+    int level = 1;
+    while (level < SKIP_LEVELS && (random() & 1)) {
+        level++;
+    }
+    if (level > stats->levels) {
+        stats->levels = level;
+    }
+
+    struct rank_node *x = &(stats->head);
+    for (int l = stats->levels - 1; l >= 0; l--) {
+        while (x->next[l] != NULL && ranks_before(stats, x->next[l]->player, player)) {
+            x = x->next[l];
+        }
+        if (l < level) {
+            node->next[l] = x->next[l];
+            x->next[l] = node;
+        }
+    }
+}
+
+/* Take player off the leaderboard. Must be done before changing anything
+ * ranks_before looks at, and followed by rank_player.
+ */
+void unrank_player(struct stats *stats, int player) {
+    struct rank_node *node = stats->ranks[player];
+    struct rank_node *x = &(stats->head);
+    for (int l = stats->levels - 1; l >= 0; l--) {
+        while (x->next[l] != NULL && x->next[l] != node && ranks_before(stats, x->next[l]->player, player)) {
+            x = x->next[l];
+        }
+        if (x->next[l] == node) {
+            x->next[l] = node->next[l];
+        }
+    }
+}
+
+/* Return the slot of stats->index that holds name's player, or the empty slot where
+ * it would go.
+ */
+int *index_slot(struct stats *stats, const char *name) {
+    unsigned mask = stats->index_size - 1;
+    unsigned i = hash_name(name) & mask;
+    while (stats->index[i] != -1 && strcmp(stats->file->players[stats->index[i]].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &(stats->index[i]);
+}
+
+/* Return the index of name's statistics, adding a new player if we haven't seen
+ * name before. Return -1 if there is no room for another player.
+ */
+int find_player(struct stats *stats, const char *name) {
+    int *slot = index_slot(stats, name);
+    if (*slot != -1) {
+        return *slot;
+    }
+    if (stats->file->count == STATS_MAX) {
+        fprintf(stderr, "No room to keep stats for %s\n", name);
+        return -1;
+    }
+
+    int player = stats->file->count;
+    struct player_stats *p = &(stats->file->players[player]);
+    memset(p, 0, sizeof(struct player_stats));
+    strncpy(p->name, name, MAX_NAME);
+    p->name[MAX_NAME - 1] = '\0';
+    stats->file->count++; // Only after the record is complete, in case we crash.
+
+    *slot = player;
+    rank_player(stats, player);
+    return player;
+}
+
+/* Rewrite the leaderboard message from the top LEADERBOARD_SIZE players. Only the
+ * stats thread writes it; copy_leaderboard readers retry if they overlap.
+ */
+void write_leaderboard(struct stats *stats) {
+    char buf[LEADERBOARD_MSG];
+    int len = sprintf(buf, "Leaderboard:\r\n");
+    struct rank_node *node = stats->head.next[0];
+    for (int rank = 1; node != NULL && rank <= LEADERBOARD_SIZE; rank++, node = node->next[0]) {
+        struct player_stats *p = &(stats->file->players[node->player]);
+        int accuracy = p->guesses ? 100 * p->correct_guesses / p->guesses : 0;
+        len += sprintf(buf + len, "%2d. %s: %d wins, %d games, %d guesses, %d%% correct\r\n",
+                       rank, p->name, p->wins, p->games_played, p->guesses, accuracy);
+    }
+
+    seqlock_begin_write(&(stats->seq));
+    memcpy(stats->leaderboard, buf, len + 1);
+    seqlock_end_write(&(stats->seq));
+}
+
+/* Copy the current leaderboard message into buf, which must have room for
+ * LEADERBOARD_MSG bytes. Game threads call this while the stats thread may be
+ * rewriting the message, and copy it again if it was.
+ */
+void copy_leaderboard(struct stats *stats, char *buf) {
+    unsigned seq;
+    do {
+        seq = seqlock_begin_read(&(stats->seq));
+        memcpy(buf, stats->leaderboard, LEADERBOARD_MSG);
+    } while (seqlock_read_again(&(stats->seq), seq));
+    buf[LEADERBOARD_MSG - 1] = '\0';
+}
+
+/* Map the stats file filename into memory, creating it if it doesn't exist, build
+ * the index and leaderboard from the players in it and start the stats thread.
+ */
+void start_stats(struct stats *stats, char *filename) {
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    if (ftruncate(fd, sizeof(struct stats_file)) == -1) { // A new file is filled with zeros.
+        perror("ftruncate");
+        exit(1);
+    }
+    stats->file = mmap(NULL, sizeof(struct stats_file), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (stats->file == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd); // The mapping stays after the descriptor is closed.
+
+    // Only trust what we find if it has our layout. A damaged count would have us read
+    // and rank players past the end of the file.
+    if (stats->file->magic != STATS_MAGIC || stats->file->version != STATS_VERSION
+            || stats->file->count < 0 || stats->file->count > STATS_MAX) {
+        if (stats->file->magic != 0) { // A new file is all zeros.
+            fprintf(stderr, "%s is not a stats file this server can read, starting over\n", filename);
+        }
+        stats->file->count = 0;
+        stats->file->version = STATS_VERSION;
+        stats->file->magic = STATS_MAGIC;
+    }
+
+    stats->index_size = STATS_MAX * 2; // Keep the index at most half full.
+    stats->index = malloc(stats->index_size * sizeof(int));
+    stats->ranks = calloc(STATS_MAX, sizeof(struct rank_node *));
+    if (!stats->index || !stats->ranks) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < stats->index_size; i++) {
+        stats->index[i] = -1;
+    }
+    memset(&(stats->head), 0, sizeof(struct rank_node));
+    stats->levels = 1;
+    stats->events.top = NULL;
+    init_seqlock(&(stats->seq));
+
+    for (int player = 0; player < stats->file->count; player++) {
+        stats->file->players[player].name[MAX_NAME - 1] = '\0'; // In case the file was damaged.
+        *index_slot(stats, stats->file->players[player].name) = player;
+        rank_player(stats, player);
+    }
+    write_leaderboard(stats);
+    printf("Loaded stats for %d players from %s.\n", stats->file->count, filename);
+
+    if ((errno = pthread_create(&(stats->thread), NULL, run_stats, stats)) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+}
+
+/* Queue a stat event of the given kind for player name. Safe to call from any
+ * thread; it never waits on the stats thread. See struct stat_event.
+ */
+void record_stat(struct stats *stats, int kind, const char *name, int hit) {
+    struct stat_event *event = malloc(sizeof(struct stat_event));
+    if (!event) {
+        perror("malloc");
+        exit(1);
+    }
+    event->kind = kind;
+    event->hit = hit;
+    strncpy(event->name, name, MAX_NAME);
+    event->name[MAX_NAME - 1] = '\0';
+    mpsc_push(&(stats->events), &(event->node));
+}
+
+/* The body of the stats thread. Every STATS_INTERVAL applies the queued events to
+ * the mapped stats file and leaderboard, and every STATS_CHECKPOINT seconds flushes
+ * the changes to disk.
+ */
+void *run_stats(void *arg) {
+    struct stats *stats = arg;
+    time_t last_checkpoint = time(NULL);
+    int dirty = 0; // 1 if there are changes since the last checkpoint.
+
+    while (1) {
+        usleep(STATS_INTERVAL);
+
+        struct mpsc_node *node = mpsc_take_all(&(stats->events));
+        if (node != NULL) {
+            while (node != NULL) {
+                struct stat_event *event = (struct stat_event *)node;
+                node = node->next;
+                int player = find_player(stats, event->name);
+                if (player != -1) {
+                    struct player_stats *p = &(stats->file->players[player]);
+                    if (event->kind == STAT_GUESS) {
+                        p->guesses++;
+                        p->correct_guesses += event->hit;
+                    } else if (event->kind == STAT_GAME) {
+                        p->games_played++;
+                    } else { // STAT_WIN moves the player up the leaderboard.
+                        unrank_player(stats, player);
+                        p->wins++;
+                        rank_player(stats, player);
+                    }
+                }
+                free(event);
+            }
+            write_leaderboard(stats);
+            dirty = 1;
+        }
+
+        if (dirty && time(NULL) - last_checkpoint >= STATS_CHECKPOINT) {
+            if (msync(stats->file, sizeof(struct stats_file), MS_SYNC) == -1) {
+                perror("msync");
+            }
+            last_checkpoint = time(NULL);
+            dirty = 0;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <pthread.h>
+
+#include "gameplay.h"
+#include "queue.h"
+#include "seqlock.h"
+
+#define STATS_FILE "wordsrv.stats" // Where player statistics are kept between runs.
+#define STATS_MAGIC 0x57535431     // Marks a stats file written by this server.
+#define STATS_VERSION 1            // Bumped whenever struct stats_file changes.
+#define STATS_MAX (1 << 17)        // Most players we keep statistics for.
+#define STATS_INTERVAL 100000      // Microseconds between passes of the stats thread.
+#define STATS_CHECKPOINT 30        // Seconds between flushes of the stats file to disk.
+#define LEADERBOARD_SIZE 10        // Players shown on the leaderboard.
+#define LEADERBOARD_MSG 2048       // Room for the leaderboard message.
+#define SKIP_LEVELS 18             // Enough for a skip list of STATS_MAX players.
+
+// Kinds of stat event.
+#define STAT_GUESS 0 // The player made a valid guess.
+#define STAT_GAME 1  // The player was in a game that ended.
+#define STAT_WIN 2   // The player won a game.
+
+/* The statistics of one player, as stored in the stats file.
+ */
+struct player_stats {
+    char name[MAX_NAME];
+    int games_played;
+    int wins;
+    int guesses;
+    int correct_guesses;
+};
+
+/* The layout of the stats file, which is mapped into memory.
+ */
+struct stats_file {
+    unsigned magic;
+    unsigned version;
+    int count;           // Number of players in players.
+    struct player_stats players[STATS_MAX];
+};
+
+/* Something that happened to a player, queued for the stats thread.
+ */
+struct stat_event {
+    struct mpsc_node node; // Must be first, we cast the queue node back to the event.
+    int kind;
+    int hit;               // For STAT_GUESS, 1 if the letter was in the word.
+    char name[MAX_NAME];   // Copied, since the player may be gone by the time it's counted.
+};
+
+/* A player's place on the leaderboard, a skip list ordered best player first.
+ */
+struct rank_node {
+    int player;          // Index into the stats file's players.
+    struct rank_node *next[SKIP_LEVELS];
+};
+
+/* Player statistics and the leaderboard. Game threads only queue events and read the
+ * leaderboard message; everything else belongs to the stats thread, so recording a
+ * stat never makes a game wait.
+ */
+struct stats {
+    struct stats_file *file;  // Mapped into memory, so updates need no write calls.
+    struct mpsc_queue events;
+    int *index;               // Open addressing table from name to player, -1 if empty.
+    int index_size;
+    struct rank_node head;    // The leaderboard's first node, which is not a player.
+    int levels;               // Levels in use in the skip list.
+    struct rank_node **ranks; // Each player's node.
+    pthread_t thread;
+
+    struct seqlock seq;       // Moves whenever leaderboard is rewritten.
+    char leaderboard[LEADERBOARD_MSG];
+};
+
+void start_stats(struct stats *stats, char *filename);
+void record_stat(struct stats *stats, int kind, const char *name, int hit);
+void copy_leaderboard(struct stats *stats, char *buf);
+
+#endif
@@ -8,39 +8,121 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 #include "socket.h"
 #include "gameplay.h"
+#include "queue.h"
+#include "registry.h"
+#include "stats.h"
+#include "solver.h"
+#include "spectators.h"
 
 
 #ifndef PORT
     #define PORT 54623
 #endif
 #define MAX_QUEUE 5
+#define WATCH_CMD "/watch"  // Entered instead of a name to join as a spectator.
+#define DELTA_CMD "/delta"  // Switch to short delta board updates.
+#define FULL_CMD "/full"    // Switch back to the full board after every guess (the default).
+#define SYNC_CMD "/sync"    // Resend the full board once.
+#define TOP_CMD "/top"      // Show the leaderboard.
+#define HINT_CMD "/hint"    // Suggest the best letter to guess next.
+#define BOT_CMD "/bot"      // Add a bot player to the room.
+#define ROOM_SIZE 4         // Default number of players the matcher puts in a room.
+#define LOBBY_WAIT 10       // Seconds a player waits in the lobby before we start a room without a full table.
+#define WAITING_MSG "Waiting for more players to start a game...\r\n"
+#define FULL_MSG "Sorry, the server is full. Please try again later.\r\n"
+#define BOTS_FULL_MSG "This room already has as many bots as it can take.\r\n"
+
+// The kinds of handoff the main thread sends to a worker.
+#define HANDOFF_ROOM 0      // Start room room_id with the clients as its players.
+#define HANDOFF_SEATS 1     // Seat the clients in the worker's rooms, in seats taken with take_seats.
+
+/* Clients passed from the main thread to a worker.
+ * The worker takes ownership of the clients and frees the handoff.
+ */
+struct handoff {
+    struct mpsc_node node; // Must be first, we cast the queue node back to the handoff.
+    int kind;
+    int room_id;
+    struct client *clients;
+};
+
+/* A worker thread runs its own poll loop over the rooms it has been handed.
+ * Only the worker itself touches its rooms; the main thread only pushes to inbox.
+ */
+struct worker {
+    pthread_t thread;
+    struct mpsc_queue inbox;  // Handoffs from the main thread.
+    int wake_fd[2];           // Pipe the main thread writes a byte to after pushing to inbox.
+    struct game_state *rooms; // The rooms this worker is running.
+    int open_seats;           // Free seats in rooms, less those the main thread has taken. See take_seats.
+    int seats_free;           // Worker only: free seats as of when open_seats was last updated.
+    int players;              // People in rooms, as of the worker's last pass.
+    int taken;                // Players taken from inbox so far, published after players.
+    int sent;                 // Main thread only: players handed off to this worker so far.
+    struct pollfd *fds;       // What poll watches: the wake pipe, then every player's socket.
+    struct game_state **fd_rooms; // The room of each socket in fds.
+    int fds_size;             // Entries fds and fd_rooms have room for.
+};
 
 
 int find_network_newline(const char *buf, int n);
 void add_player(struct client **top, int fd, struct in_addr addr);
 void remove_player(struct client **top, int fd, struct game_state *game);
+struct client *detach_client(struct client **top, int fd);
 int safe_write(struct client **top, struct client *p, char *msg, struct game_state *game);
-void add_to_game(struct client **new_players_adr, struct client *p, struct game_state *game);
+void add_to_lobby(struct client **new_players_adr, struct client **lobby_adr, struct client *p, const char *name);
+int match_players(struct client **lobby_adr, struct worker *workers, int num_workers, int next_room_id);
+struct client *take_oldest(struct client **lobby_adr, int n);
+struct worker *least_loaded(struct worker *workers, int num_workers);
+int take_seats(int *open_seats, int least, int most);
 void broadcast(struct game_state *game, char *outbuf);
+void broadcast_status(struct game_state *game, char letter);
+void announce_guess(struct game_state *game, const char *name, char letter);
+int handle_command(struct game_state *game, struct client *p);
+void handle_player_input(struct game_state *game, struct client *p);
+void play_guess(struct game_state *game, struct client *p, char p_guess);
+int add_bot(struct game_state *game);
+int has_humans(struct game_state *game);
+int bot_to_move(struct game_state *game);
+void play_bots(struct worker *w);
 void announce_turn(struct game_state *game);
 void announce_winner(struct game_state *game, struct client *winner);
 void advance_turn(struct game_state *game);
+void record_game(struct game_state *game, struct client *winner);
+struct worker *start_workers(int num_workers);
+void *run_worker(void *arg);
+void hand_off(struct worker *w, int kind, int room_id, struct client *clients);
+int take_handoffs(struct worker *w);
+void start_room(struct worker *w, int room_id, struct client *players);
+void seat_players(struct worker *w, struct client *players);
+void free_seats(struct worker *w);
+void close_empty_rooms(struct worker *w);
+int count_humans(struct game_state *game);
+int watch_players(struct worker *w);
+int watch_clients(struct pollfd **fds, int *fds_size, int listenfd, struct client *new_players, struct client *lobby);
+void refuse_client(int listenfd, int *spare_fd);
+void raise_fd_limit(void);
 
 /* Send the message in outbuf to all clients */
 
-/* The set of socket descriptors for select to monitor.
- * This is a global variable because we need to remove socket descriptors
- * from allset when a write to a socket fails.
- */
-fd_set allset;
+struct dictionary dict;   // The words every room picks from.
+int room_size = ROOM_SIZE;
+struct registry names;    // Names in use by players anywhere on the server.
+struct stats stats;       // Statistics of every player who has played here.
+struct solver solver;     // Index over the dictionary for hints and bots.
+struct spectators spectators; // Everyone watching a game, served by a thread of their own.
 
 int main(int argc, char **argv) {
     // Fix from piazza: install handler for SIG_IGN
@@ -53,32 +135,42 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
-    int clientfd, maxfd, nready;
+    int clientfd, nready;
     struct client *p;
     struct sockaddr_in q;
-    fd_set rset;
-    
-    if(argc != 2){
-        fprintf(stderr,"Usage: %s <dictionary filename>\n", argv[0]);
+
+    if(argc < 2 || argc > 4){
+        fprintf(stderr,"Usage: %s <dictionary filename> [room size] [workers]\n", argv[0]);
         exit(1);
     }
-    
-    // Create and initialize the game state
-    struct game_state game;
 
+    // By default leave one core for the main thread and give the rest to workers.
+    int num_workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (num_workers < 1) {
+        num_workers = 1;
+    }
+    if (argc >= 3) {
+        room_size = strtol(argv[2], NULL, 10);
+    }
+    if (argc == 4) {
+        num_workers = strtol(argv[3], NULL, 10);
+    }
+    if (room_size < 1 || num_workers < 1) {
+        fprintf(stderr, "Room size and number of workers must be at least 1\n");
+        exit(1);
+    }
+
+    raise_fd_limit();
     srandom((unsigned int)time(NULL));
-    // Set up the file pointer outside of init_game because we want to 
-    // just rewind the file when we need to pick a new word.
-    game.dict.fp = NULL;
-    game.dict.size = get_file_length(argv[1]);
+    // Read the dictionary once, every room picks its words from the same copy.
+    load_dictionary(&dict, argv[1]);
+    init_solver(&solver, &dict);
+    init_registry(&names, REGISTRY_SIZE);
+    start_stats(&stats, STATS_FILE);
+    start_spectators(&spectators);
+
+    struct worker *workers = start_workers(num_workers);
 
-    init_game(&game, argv[1]);
-    
-    // head and has_next_turn also don't change when a subsequent game is
-    // started so we initialize them here.
-    game.head = NULL;
-    game.has_next_turn = NULL;
-    
     /* A list of client who have not yet entered their name.  This list is
      * kept separate from the list of active players in the game, because
      * until the new playrs have entered a name, they should not have a turn
@@ -86,185 +178,80 @@ int main(int argc, char **argv) {
      * they have a name.
      */
     struct client *new_players = NULL;
-    
+
+    /* Named clients waiting for match_players to put them in a room, newest
+     * first. Once in a room, a client belongs to the worker running the room.
+     */
+    struct client *lobby = NULL;
+    int next_room_id = 0; // The most recently started room is next_room_id - 1.
+
     struct sockaddr_in *server = init_server_addr(PORT);
     int listenfd = set_up_server_socket(server, MAX_QUEUE);
-    
-    // Initialize allset and add listenfd to the
-    // set of file descriptors passed into select.
-    FD_ZERO(&allset);
-    FD_SET(listenfd, &allset);
-    // maxfd identifies how far into the set to search
-    maxfd = listenfd;
+
+    // Held open so that once we are out of descriptors, there is still one to accept
+    // a client with and tell it the server is full. See refuse_client.
+    int spare_fd = open("/dev/null", O_RDONLY);
+
+    struct pollfd *fds = NULL; // What poll watches, see watch_clients.
+    int fds_size = 0;
 
     while (1) {
-        // Make a copy of allset before we pass it into select.
-        rset = allset; // read set
-        nready = select(maxfd + 1, &rset, NULL, NULL, NULL); // Blocks until a fd in rset has data or is closed
+        int num_fds = watch_clients(&fds, &fds_size, listenfd, new_players, lobby);
+        // While players are waiting in the lobby, wake up every second to check if they have waited too long.
+        nready = poll(fds, num_fds, lobby ? 1000 : -1); // Blocks until a fd in fds has data or is closed
         if (nready == -1) {
-            perror("select");
+            perror("poll");
             continue;
         }
 
-        if (FD_ISSET(listenfd, &rset)){
+        if (fds[0].revents & POLLIN) { // fds[0] is listenfd.
             printf("A new client is connecting\n");
             clientfd = accept_connection(listenfd);
 
-            FD_SET(clientfd, &allset);
-            if (clientfd > maxfd) {
-                maxfd = clientfd;
+            if (clientfd == -1) {
+                if (errno == EMFILE || errno == ENFILE) { // Out of descriptors.
+                    refuse_client(listenfd, &spare_fd);
+                }
+            } else {
+                printf("Connection from %s\n", inet_ntoa(q.sin_addr)); // ignore the q (i think)
+                add_player(&new_players, clientfd, q.sin_addr); // add newly connected client to new_players
+                char *greeting = WELCOME_MSG;
+                if (write(clientfd, greeting, strlen(greeting)) == -1) {
+                    fprintf(stderr, "Write to client %s failed\n", inet_ntoa(q.sin_addr));
+                    remove_player(&new_players, clientfd, NULL);
+                };
             }
-            printf("Connection from %s\n", inet_ntoa(q.sin_addr)); // ignore the q (i think)
-            add_player(&new_players, clientfd, q.sin_addr); // add newly connected client to new_players
-            char *greeting = WELCOME_MSG;
-            if (write(clientfd, greeting, strlen(greeting)) == -1) {
-                fprintf(stderr, "Write to client %s failed\n", inet_ntoa(q.sin_addr));
-                remove_player(&new_players, clientfd, NULL);
-            };
-        }
-        
+        }
+
         /* Check which other socket descriptors have something ready to read.
-         * The reason we iterate over the rset descriptors at the top level and
+         * The reason we iterate over the polled descriptors at the top level and
          * search through the two lists of clients each time is that it is
          * possible that a client will be removed in the middle of one of the
          * operations. This is also why we call break after handling the input.
-         * If a client has been removed the loop variables may not longer be 
+         * If a client has been removed the loop variables may not longer be
          * valid.
          */
-        int cur_fd;
-        for(cur_fd = 0; cur_fd <= maxfd; cur_fd++) {
-            if(FD_ISSET(cur_fd, &rset)) { // There are things to read from cur_fd.
-                // Check if this socket descriptor is an active player.
-                for(p = game.head; p != NULL; p = p->next) {
+        for (int i = 1; i < num_fds; i++) {
+            int cur_fd = fds[i].fd;
+            if (fds[i].revents) { // There are things to read from cur_fd, or it has closed.
+                // Check if a player in the lobby sent something. There is nothing for them to
+                // do until they are in a room, but we need to notice them leaving.
+                for(p = lobby; p != NULL; p = p->next) {
                     if(cur_fd == p->fd) {
-                        // Handle input from an active client.
-                        int num_in_buf = p->in_ptr - p->inbuf;
-                        int room_in_buf = MAX_BUF - 3 - num_in_buf; // -1 for \0 and -2 for \r\n
-                        int num_read; // Number of bytes (and thus characters) read from cur_fd.
-                        if ((num_read = read(cur_fd, p->in_ptr, room_in_buf)) <= 0) {
-                            if (num_read == 0) {  // For sockets, read performs like recv w/ no flags. 0 means client dropped out.
-                                printf("[%d] read 0 bytes.\n", cur_fd);
-                                remove_player(&(game.head), cur_fd, &game);
-                                break;
-                            }
-                            perror("read");
-                            exit(1);
-                        }
-
-                        // Client still connected if we get here.
-                        printf("[%d] read %d bytes.\n", cur_fd, num_read);
-                        
-                        // Update values.
-                        p->in_ptr += num_read; 
-                        num_in_buf += num_read;
-                        room_in_buf -= num_read;
-
-                        // Check if partial read.
-                        int where; // The index after the \n in p->inbuf, if it exists.
-                        if ((where = find_network_newline(p->inbuf, num_in_buf)) == -1) { // No \r\n means only partial read.
-                            if (room_in_buf == 0) { // Reached max length and no \r\n yet, so input is invalid. 
-                                // (we are supposed to assume this never happens but we'll partially handle it)
-                                char msg[] = "Your input was too long! Weird stuff might happen now.\r\n";
-                                if (safe_write(&(game.head), p, msg, &game) != -1) { // Player still connected, can reference p.
-                                    p->in_ptr = p->inbuf;
-                                }
-                            }
-                            break;
-                        }
-
-                        // We have a full line if we get here.
-                        (p->inbuf)[where-2] = '\0'; // Cut out network newline and null terminate.                        
-                        printf("[%d] found newline %s.\n", cur_fd, p->inbuf);
-
-                        // Check if it's this player's turn.
-                        if (p != game.has_next_turn) {
-                            printf("Player %s tried to guess out of turn.\n", p->name);
-                            char msg[] = "It is not your turn to guess.\r\n";
-                            if (safe_write(&(game.head), p, msg, &game) != -1) { // Player still connected, can reference p.
-                                p->in_ptr = p->inbuf;
-                            }
-                            break;
+                        if (read(cur_fd, p->inbuf, MAX_BUF) <= 0) { // Client dropped out.
+                            printf("[%d] left the lobby.\n", cur_fd);
+                            remove_player(&lobby, cur_fd, NULL);
                         }
-
-                        // It's this player's turn if we get here.
-
-                        // Check if the guess is valid
-                        char p_guess = (p->inbuf)[0];
-                        // Check client guessed a single lowercase letter that is not already guessed. Makes use of short circuiting.
-                        if (where != 3 || p_guess < 'a' || p_guess > 'z' || game.letters_guessed[p_guess - 'a'] == 1) { 
-                            printf("%s's guess was invalid.\n", p->name);
-                            char msg[] = "Invalid guess. Please guess again.\r\n";
-                            if (safe_write(&(game.head), p, msg, &game) != -1) { // player still connected
-                                p->in_ptr = p->inbuf;
-                            }
-                            break;
-                        } 
-
-                        // Guess is valid if we get here.
-
-                        // Update letters_guessed, reset in_ptr and save current client name in case they disconnect.
-						game.letters_guessed[p_guess - 'a'] = 1;
-                        p->in_ptr = p->inbuf;
-                        char p_name[MAX_NAME];
-                        strcpy(p_name, p->name); // strcpy safe since p->name null terminated and p_name big enough.
-                        
-                        // Check if guess in word and update game.guess accordingly.
-                        char guess_in_word = 0;
-						char solved = 1;
-                        char letter;
-                        int j = 0;
-                        while ((letter = (game.word)[j]) != '\0') {
-                            if (letter == p_guess) {
-                                (game.guess)[j] = letter;
-                                guess_in_word = 1;
-                            } else if ((game.guess)[j] == '-') { // Still an unguessed letter so game isn't solved.
-								solved = 0;
-							}
-							j++;
-                        }
-						
-                        // Decide what to do depending on if guess was in the word and if the game is over.
-						if (guess_in_word) {
-							if (solved) { // Game solved, start a new game.
-								announce_winner(&game, p);
-								init_game(&game, argv[1]);									
-							} else { // We announce the guess iff game doesn't end.
-								char msg[MAX_MSG];
-								sprintf(msg, "%s guesses: %c\r\n", p_name, p_guess); // null terminates msg
-								broadcast(&game, msg);
-							}
-						} else { // Guess wasn't in the word, advance the turn.
-                            printf("Letter %c is not in the word.\n", p_guess);
-							char msg[MAX_MSG];
-                            sprintf(msg, "%c is not in the word\r\n", p_guess);
-                            advance_turn(&game); // Must do before safe_write because safe_write could destroy client pointed to by p.
-                            safe_write(&(game.head), p, msg, &game);
-                            if (game.guesses_left == 0) { // Game over, start a new game.
-                                printf("Game Over\nNew Game\n");
-                                sprintf(msg, "No more guesses.  The word was %s.\r\n\r\nLet's start a new game.\r\n", game.word);
-                                broadcast(&game, msg);
-                                init_game(&game, argv[1]);                          
-                            } else { // We announce the guess iff game doesn't end.
-                                sprintf(msg, "%s guesses: %c\r\n", p_name, p_guess); // null terminates msg
-                                broadcast(&game, msg);
-                            }	
-						}
-						
-                        // Broadcast gurrent game status and announce whos turn it is.
-                        char msg[MAX_MSG]; 
-                        status_message(msg, &game);
-                        broadcast(&game, msg);
-                        announce_turn(&game);
                         break;
                     }
                 }
-        
+
                 // Check if any new players are entering their names
                 for(p = new_players; p != NULL; p = p->next) {
                     if(cur_fd == p->fd) {
                         // Handle input from an new client who has not entered an acceptable name.
                         // (Piazza says to assume name entered will not exceed MAX_NAME-1 characters)
-                        
+
                         int num_in_buf = p->in_ptr - p->inbuf; // Number of bytes/characters in inbuf
                         int room_in_buf = MAX_NAME + 1 - num_in_buf; // Space available in inbuf.
                                                                      // Name's at most MAX_NAME-1 chars. (-1 for \0).
@@ -273,25 +260,25 @@ int main(int argc, char **argv) {
                         if ((num_read = read(cur_fd, p->in_ptr, room_in_buf)) <= 0) {
                             if (num_read == 0) { // For sockets, read performs like recv w/ no flags. 0 means client dropped out.
                                 printf("[%d] read 0 bytes.\n", cur_fd);
-                                remove_player(&new_players, cur_fd, NULL);
-                                break;
+                            } else { // An error such as a reset connection only loses us this client.
+                                perror("read");
                             }
-                            perror("read");
-                            exit(1);
+                            remove_player(&new_players, cur_fd, NULL);
+                            break;
                         }
 
                         // Client still connected if we get here.
                         printf("[%d] read %d bytes.\n", cur_fd, num_read);
 
                         // Update values.
-                        p->in_ptr += num_read; 
+                        p->in_ptr += num_read;
                         num_in_buf += num_read;
                         room_in_buf -= num_read;
 
                         // Check if partial read.
                         int where; // index after network newline in p->inbuf
                         if ((where = find_network_newline(p->inbuf, num_in_buf)) == -1) { // No \r\n means only partial read.
-                            if (room_in_buf == 0) { // Reached max name length and no \r\n yet, so name is invalid. 
+                            if (room_in_buf == 0) { // Reached max name length and no \r\n yet, so name is invalid.
                                 // (we are supposed to assume this never happens but we'll partially handle it)
                                 char msg[] = "Your name was too long! It might look weird now.\r\n";
                                 if (safe_write(&new_players, p, msg, NULL) != -1) { // Client is still connected.
@@ -302,7 +289,7 @@ int main(int argc, char **argv) {
                         }
 
                         // We have a full line if we get here.
-                        (p->inbuf)[where-2] = '\0'; // Cut out network newline and null terminate.                        
+                        (p->inbuf)[where-2] = '\0'; // Cut out network newline and null terminate.
                         printf("[%d] found newline %s.\n", cur_fd, p->inbuf);
 
                         // Check if name empty.
@@ -314,35 +301,220 @@ int main(int argc, char **argv) {
                             }
                             break;
                         }
-                            
-                        // Check if name already in use by iterating through active players in game.head.
-                        char name_in_use = 0;
-                        for (struct client *player = game.head; player != NULL; player = player->next) {
-                            if (strlen(player->name) == strlen(p->inbuf) && strcmp(player->name, p->inbuf) == 0) {
-                                // strcmp/strlen safe since both null terminated.
-                                printf("[%d] name \"%s\" was already taken.\n", cur_fd, player->name);
-                                char msg[] = "Sorry, that name is taken! Please enter a new name.\r\n";
-                                name_in_use = 1;
-								p->in_ptr = p->inbuf;
-                                safe_write(&new_players, p, msg, NULL);
+
+                        // Check if client wants to watch instead of play. "/watch" watches the latest
+                        // room and "/watch <n>" watches room n.
+                        int cmd_len = strlen(WATCH_CMD);
+                        if (strncmp(p->inbuf, WATCH_CMD, cmd_len) == 0
+                                && (p->inbuf[cmd_len] == '\0' || p->inbuf[cmd_len] == ' ')) {
+                            int room_id = next_room_id - 1;
+                            if (p->inbuf[cmd_len] == ' ') {
+                                room_id = strtol(p->inbuf + cmd_len + 1, NULL, 10);
+                            }
+                            if (room_id < 0 || room_id >= next_room_id) {
+                                printf("[%d] asked to watch a game that doesn't exist.\n", cur_fd);
+                                char msg[] = "There is no such game to watch. What is your name? ";
+                                if (safe_write(&new_players, p, msg, NULL) != -1) { // Client still connected.
+                                    p->in_ptr = p->inbuf;
+                                }
                                 break;
                             }
+                            // The spectator thread reads from the spectator from now on.
+                            tell_spectators(&spectators, SPECTATE_WATCH, room_id, NULL,
+                                            detach_client(&new_players, cur_fd));
+                            break;
+                        }
+
+                        // Reserve the name so no other player on the server can use it until this one leaves.
+                        const char *name;
+                        int reserved = reserve_name(&names, p->inbuf, &name);
+                        if (reserved == NAME_TAKEN) {
+                            printf("[%d] name \"%s\" was already taken.\n", cur_fd, p->inbuf);
+                            char msg[] = "Sorry, that name is taken! Please enter a new name.\r\n";
+							p->in_ptr = p->inbuf;
+                            safe_write(&new_players, p, msg, NULL);
+                            break;
                         }
-                        if (name_in_use) {
+                        if (reserved == REGISTRY_FULL) { // No name would work, so don't ask for another.
+                            printf("[%d] turned away, no room for more names.\n", cur_fd);
+                            if (safe_write(&new_players, p, FULL_MSG, NULL) != -1) {
+                                remove_player(&new_players, cur_fd, NULL);
+                            }
                             break;
                         }
 
-                        // Name is valid so add client to game.head and remove from new_players.
-                        add_to_game(&new_players, p, &game);
+                        // Name is valid so move client to the lobby to wait for a room.
+                        add_to_lobby(&new_players, &lobby, p, name);
                         break;
-                    } 
+                    }
                 }
             }
         }
+
+        // Put the players that are ready into rooms.
+        next_room_id = match_players(&lobby, workers, num_workers, next_room_id);
     }
     return 0;
 }
 
+/* Handle input from p, an active player in game.
+ */
+void handle_player_input(struct game_state *game, struct client *p) {
+    int cur_fd = p->fd;
+    int num_in_buf = p->in_ptr - p->inbuf;
+    int room_in_buf = MAX_BUF - 3 - num_in_buf; // -1 for \0 and -2 for \r\n
+    int num_read; // Number of bytes (and thus characters) read from cur_fd.
+    if ((num_read = read(cur_fd, p->in_ptr, room_in_buf)) <= 0) {
+        if (num_read == 0) {  // For sockets, read performs like recv w/ no flags. 0 means client dropped out.
+            printf("[%d] read 0 bytes.\n", cur_fd);
+        } else { // An error such as a reset connection only loses us this player, not every room.
+            perror("read");
+        }
+        remove_player(&(game->head), cur_fd, game);
+        return;
+    }
+
+    // Client still connected if we get here.
+    printf("[%d] read %d bytes.\n", cur_fd, num_read);
+
+    // Update values.
+    p->in_ptr += num_read; 
+    num_in_buf += num_read;
+    room_in_buf -= num_read;
+
+    // Check if partial read.
+    int where; // The index after the \n in p->inbuf, if it exists.
+    if ((where = find_network_newline(p->inbuf, num_in_buf)) == -1) { // No \r\n means only partial read.
+        if (room_in_buf == 0) { // Reached max length and no \r\n yet, so input is invalid. 
+            // (we are supposed to assume this never happens but we'll partially handle it)
+            char msg[] = "Your input was too long! Weird stuff might happen now.\r\n";
+            if (safe_write(&(game->head), p, msg, game) != -1) { // Player still connected, can reference p.
+                p->in_ptr = p->inbuf;
+            }
+        }
+        return;
+    }
+
+    // We have a full line if we get here.
+    (p->inbuf)[where-2] = '\0'; // Cut out network newline and null terminate.                        
+    printf("[%d] found newline %s.\n", cur_fd, p->inbuf);
+
+    // Commands can be used at any time, not just on this player's turn.
+    if (handle_command(game, p)) {
+        return;
+    }
+
+    // Check if it's this player's turn.
+    if (p != game->has_next_turn) {
+        printf("Player %s tried to guess out of turn.\n", p->name);
+        char msg[] = "It is not your turn to guess.\r\n";
+        if (safe_write(&(game->head), p, msg, game) != -1) { // Player still connected, can reference p.
+            p->in_ptr = p->inbuf;
+        }
+        return;
+    }
+
+    // It's this player's turn if we get here.
+
+    // Check if the guess is valid
+    char p_guess = (p->inbuf)[0];
+    // Check client guessed a single lowercase letter that is not already guessed. Makes use of short circuiting.
+    if (where != 3 || p_guess < 'a' || p_guess > 'z' || game->letters_guessed[p_guess - 'a'] == 1) { 
+        printf("%s's guess was invalid.\n", p->name);
+        char msg[] = "Invalid guess. Please guess again.\r\n";
+        if (safe_write(&(game->head), p, msg, game) != -1) { // player still connected
+            p->in_ptr = p->inbuf;
+        }
+        return;
+    } 
+
+    // Guess is valid if we get here.
+    p->in_ptr = p->inbuf;
+    play_guess(game, p, p_guess);
+}
+
+/* Play p_guess, a valid guess by p, whose turn it is in game. Then tell everyone in
+ * game what happened and whose turn it is now.
+ */
+void play_guess(struct game_state *game, struct client *p, char p_guess) {
+    // Update letters_guessed and save current client name in case they disconnect.
+    game->letters_guessed[p_guess - 'a'] = 1;
+    char p_name[MAX_NAME];
+    strcpy(p_name, p->name); // strcpy safe since p->name null terminated and p_name big enough.
+
+    // Check if guess in word and update game->guess accordingly.
+    char guess_in_word = 0;
+    char solved = 1;
+    char new_game = 0; // Set if the guess ended the game, so delta players need a full board.
+    char letter;
+    int j = 0;
+    while ((letter = game->word[j]) != '\0') {
+        if (letter == p_guess) {
+            game->guess[j] = letter;
+            guess_in_word = 1;
+        } else if (game->guess[j] == '-') { // Still an unguessed letter so game isn't solved.
+            solved = 0;
+        }
+        j++;
+    }
+    if (!p->bot) { // The leaderboard is for people only.
+        record_stat(&stats, STAT_GUESS, p->name, guess_in_word);
+    }
+
+    // Decide what to do depending on if guess was in the word and if the game is over.
+    if (guess_in_word) {
+        if (solved) { // Game solved, start a new game.
+            record_game(game, p);
+            announce_winner(game, p);
+            tell_spectators(&spectators, SPECTATE_BOARD, game->id, take_snapshot(game, 1), NULL);
+            init_game(game);
+            new_game = 1;
+        } else { // We announce the guess iff game doesn't end.
+            announce_guess(game, p_name, p_guess);
+        }
+    } else { // Guess wasn't in the word, advance the turn.
+        printf("Letter %c is not in the word.\n", p_guess);
+        char msg[MAX_MSG];
+        sprintf(msg, "%c is not in the word\r\n", p_guess);
+        advance_turn(game); // Must do before safe_write because safe_write could destroy client pointed to by p.
+        if (!p->delta) { // A delta player's "> x | n" line already says so.
+            safe_write(&(game->head), p, msg, game);
+        }
+        if (game->guesses_left == 0) { // Game over, start a new game.
+            printf("Game Over\nNew Game\n");
+            record_game(game, NULL);
+            sprintf(msg, "No more guesses.  The word was %s.\r\n\r\nLet's start a new game.\r\n", game->word);
+            broadcast(game, msg);
+            tell_spectators(&spectators, SPECTATE_BOARD, game->id, take_snapshot(game, 1), NULL);
+            init_game(game);
+            new_game = 1;
+        } else { // We announce the guess iff game doesn't end.
+            announce_guess(game, p_name, p_guess);
+        }
+    }
+
+    // Broadcast gurrent game status and announce whos turn it is.
+    broadcast_status(game, new_game ? '\0' : p_guess);
+    tell_spectators(&spectators, SPECTATE_BOARD, game->id, take_snapshot(game, 0), NULL);
+    if (game->has_next_turn != NULL) { // Everyone may have disconnected while we wrote to them.
+        announce_turn(game);
+    }
+}
+
+/* Count the game that just ended for every player still in game, and the win for
+ * winner if there is one.
+ */
+void record_game(struct game_state *game, struct client *winner) {
+    for (struct client *p = game->head; p != NULL; p = p->next) {
+        if (!p->bot) {
+            record_stat(&stats, STAT_GAME, p->name, 0);
+        }
+    }
+    if (winner != NULL && !winner->bot) {
+        record_stat(&stats, STAT_WIN, winner->name, 0);
+    }
+}
+
 /* Move the has_next_turn pointer to the next active client and decrement number of guesses.
  * Assume game->has_next_turn not NULL.
  */
@@ -368,16 +540,20 @@ void add_player(struct client **top, int fd, struct in_addr addr) {
 
     p->fd = fd;
     p->ipaddr = addr;
-    p->name[0] = '\0';
+    p->name = "";
     p->in_ptr = p->inbuf;
     p->inbuf[0] = '\0';
+    p->snap = NULL;
+    p->snap_off = 0;
+    p->watching = NULL;
+    p->delta = 0;
+    p->bot = 0;
     p->next = *top;
     *top = p;
 }
 
 /* Removes client from the linked list pointed to by top and closes its socket (fd).
- * Also removes socket descriptor from allset. If game is provided, will handle case 
- * where it is the client's turn.
+ * If game is provided, will handle case where it is the client's turn.
  */
 void remove_player(struct client **top, int fd, struct game_state *game) {
     struct client **p;
@@ -413,8 +589,15 @@ void remove_player(struct client **top, int fd, struct game_state *game) {
         }
         struct client *t = (*p)->next;
         printf("Removing client %d %s\n", fd, inet_ntoa((*p)->ipaddr));
-        FD_CLR((*p)->fd, &allset);
-        close((*p)->fd);
+        if (!(*p)->bot) { // Bots have no socket.
+            close((*p)->fd);
+        }
+        release_snapshot((*p)->snap);
+        if ((*p)->bot) { // Bots keep their own copy of their name, see add_bot.
+            free((char *)(*p)->name);
+        } else if ((*p)->name[0] != '\0') { // Only named clients have a name reserved.
+            release_name(&names, (*p)->name);
+        }
         free(*p);
         *p = t;
         if (game) {
@@ -443,6 +626,9 @@ void remove_player(struct client **top, int fd, struct game_state *game) {
 // included exclusively for the remove_player call. Assume msg is null-terminated.
 int safe_write(struct client **top, struct client *p, char *msg, struct game_state* game) {
     int n;
+    if (p->bot) { // Bots don't read what they are sent.
+        return strlen(msg);
+    }
     if ((n = write(p->fd, msg, strlen(msg))) != strlen(msg)) { // Piazza says assume socket closed
         remove_player(top, p->fd, game);
         n = -1;
@@ -512,47 +698,667 @@ void broadcast(struct game_state *game, char *outbuf) {
     }
 }
 
-/* Add client p to game.head and remove it from new_players which is pointed to by new_players_adr. */
-void add_to_game(struct client **new_players_adr, struct client *p, struct game_state *game) {
-    // Add player to game.head
-    add_player(&(game->head), p->fd, p->ipaddr);
-    strcpy((game->head)->name, p->inbuf); // inbuf null terminated, has length at most MAX_NAME (with \0), so strcpy safe.
-    if (game->has_next_turn == NULL) { // First player in game.
-        game->has_next_turn = game->head;
-    }  
-
-    // Remove p from new_players 
-    struct client **player;   
-    for (player = new_players_adr; *player && (*player)->fd != p->fd; player = &(*player)->next);
-    if (*player) {
-        struct client *t = (*player)->next;
-        free(*player);
-        *player = t;
-    } else {
-        fprintf(stderr, "Trying to remove fd %d from new_players, but I don't know about it\n",
-                 p->fd);
-    } 
+/* Tell the players in game.head that name guessed letter. Players in delta mode are
+ * skipped, since their delta line (see broadcast_status) starts with the letter.
+ */
+void announce_guess(struct game_state *game, const char *name, char letter) {
+    char msg[MAX_MSG];
+    sprintf(msg, "%s guesses: %c\r\n", name, letter); // null terminates msg
+    struct client *p = game->head;
+    while (p != NULL) {
+        struct client *temp = p->next; // Do first in case we remove p
+        if (!p->delta) {
+            safe_write(&(game->head), p, msg, game);
+        }
+        p = temp;
+    }
+}
+
+/* Send every player in game.head the board after letter was guessed. Players in delta
+ * mode only get what the guess changed (see delta_message), everyone else gets the full
+ * status_message. Each message is built at most once per call. If letter is '\0' the
+ * board has been reset, so everyone gets the full board.
+ */
+void broadcast_status(struct game_state *game, char letter) {
+    char full[MAX_MSG];
+    char delta[MAX_MSG];
+    int full_len = 0;  // 0 until the message is built.
+    int delta_len = 0;
 
-    // Save game->head for comparison later.
-    struct client *temp = game->head;
+    struct client *p = game->head;
+    while (p != NULL) {
+        struct client *temp = p->next; // Do first in case we remove p
+        char *msg;
+        if (p->delta && letter != '\0') {
+            if (delta_len == 0) {
+                delta_len = strlen(delta_message(delta, game, letter));
+            }
+            msg = delta;
+        } else {
+            if (full_len == 0) {
+                full_len = strlen(status_message(full, game));
+            }
+            msg = full;
+        }
+        safe_write(&(game->head), p, msg, game);
+        p = temp;
+    }
+}
 
-    // Notify active players of new joiner.
+/* If p->inbuf holds a command, carry it out and return 1. Otherwise return 0 so the
+ * input is treated as a guess. Assume p->inbuf is null terminated.
+ */
+int handle_command(struct game_state *game, struct client *p) {
     char msg[MAX_MSG];
-    sprintf(msg, "%s has just joined.\r\n", (game->head)->name); // null terminates msg
-    broadcast(game, msg);
+    if (strcmp(p->inbuf, TOP_CMD) == 0) {
+        printf("%s used command %s.\n", p->name, p->inbuf);
+        char board[LEADERBOARD_MSG];
+        copy_leaderboard(&stats, board);
+        p->in_ptr = p->inbuf;
+        safe_write(&(game->head), p, board, game);
+        return 1;
+    }
 
-    // If game->head disconnected then broadcast would have changed it. Make sure still the same.
-    if (temp != game->head) {
-        return;
+    if (strcmp(p->inbuf, HINT_CMD) == 0) {
+        printf("%s used command %s.\n", p->name, p->inbuf);
+        char letter = best_letter(&solver, game);
+        if (letter == '\0') {
+            sprintf(msg, "Sorry, there is no hint for this word.\r\n");
+        } else {
+            sprintf(msg, "Hint: try %c.\r\n", letter);
+        }
+        p->in_ptr = p->inbuf;
+        safe_write(&(game->head), p, msg, game);
+        return 1;
+    }
+
+    if (strcmp(p->inbuf, BOT_CMD) == 0) {
+        printf("%s used command %s.\n", p->name, p->inbuf);
+        p->in_ptr = p->inbuf;
+        if (add_bot(game) == -1) {
+            safe_write(&(game->head), p, BOTS_FULL_MSG, game);
+        }
+        return 1;
+    }
+
+    if (strcmp(p->inbuf, DELTA_CMD) == 0) {
+        p->delta = 1;
+    } else if (strcmp(p->inbuf, FULL_CMD) == 0) {
+        p->delta = 0;
+    } else if (strcmp(p->inbuf, SYNC_CMD) != 0) {
+        return 0;
+    }
+    printf("%s used command %s.\n", p->name, p->inbuf);
+
+    // Every command resyncs the player, so a delta player has a full board to apply deltas to.
+    p->in_ptr = p->inbuf;
+    status_message(msg, game);
+    safe_write(&(game->head), p, msg, game);
+    return 1;
+}
+
+/* Remove the client with socket descriptor fd from the linked list pointed to by top and
+ * return it, without closing its socket or freeing it. Return NULL if it isn't in the list.
+ * Used to move a client from one list to another.
+ */
+struct client *detach_client(struct client **top, int fd) {
+    struct client **p;
+    for (p = top; *p && (*p)->fd != fd; p = &(*p)->next);
+    if (*p == NULL) {
+        fprintf(stderr, "Trying to detach fd %d, but I don't know about it\n", fd);
+        return NULL;
+    }
+    struct client *t = *p;
+    *p = t->next;
+    t->next = NULL;
+    return t;
+}
+
+/* Move client p from new_players to the lobby, where it waits for match_players to put it
+ * in a room. new_players_adr and lobby_adr point to the two lists. name is p's name,
+ * already reserved in the registry.
+ */
+void add_to_lobby(struct client **new_players_adr, struct client **lobby_adr, struct client *p, const char *name) {
+    detach_client(new_players_adr, p->fd);
+    p->name = name;
+    p->in_ptr = p->inbuf;
+    p->joined = time(NULL);
+    p->next = *lobby_adr;
+    *lobby_adr = p;
+
+    printf("%s is waiting in the lobby.\n", p->name);
+    safe_write(lobby_adr, p, WAITING_MSG, NULL);
+}
+
+/* Put the players waiting in the lobby pointed to by lobby_adr into rooms. Seats left
+ * free in rooms already playing are filled first. After that a new room is started as
+ * soon as room_size players are waiting, or with everyone who is waiting once the oldest
+ * of them has waited LOBBY_WAIT seconds, on the worker with the fewest players. Players
+ * are taken oldest first. Return the id of the next room to be started.
+ */
+int match_players(struct client **lobby_adr, struct worker *workers, int num_workers, int next_room_id) {
+    for (int i = 0; i < num_workers && *lobby_adr != NULL; i++) {
+        int waiting = 0;
+        for (struct client *p = *lobby_adr; p != NULL; p = p->next) {
+            waiting++;
+        }
+        int n = take_seats(&(workers[i].open_seats), 1, waiting);
+        if (n > 0) {
+            printf("Seating %d players in rooms on worker %d.\n", n, i);
+            hand_off(&workers[i], HANDOFF_SEATS, -1, take_oldest(lobby_adr, n));
+        }
+    }
+
+    while (1) {
+        int waiting = 0;
+        struct client *oldest = NULL; // New players are added at the head, so this is the last one.
+        for (struct client *p = *lobby_adr; p != NULL; p = p->next) {
+            waiting++;
+            oldest = p;
+        }
+        if (waiting < room_size && (waiting == 0 || time(NULL) - oldest->joined < LOBBY_WAIT)) {
+            return next_room_id;
+        }
+
+        int n = waiting < room_size ? waiting : room_size;
+        struct worker *w = least_loaded(workers, num_workers);
+        printf("Starting game %d with %d players on worker %d.\n", next_room_id, n, (int)(w - workers));
+        tell_spectators(&spectators, SPECTATE_OPEN, next_room_id, NULL, NULL);
+        hand_off(w, HANDOFF_ROOM, next_room_id, take_oldest(lobby_adr, n));
+        next_room_id++;
     }
+}
 
-    // Show new player the game state.
-    char status[MAX_MSG];
-    status_message(status, game); // Null terminated
-    if (safe_write(&(game->head), game->head, status, game) == -1) { // Client disconnected.
+/* Cut the n oldest players off the end of the lobby pointed to by lobby_adr, which
+ * holds at least n, and return them.
+ */
+struct client *take_oldest(struct client **lobby_adr, int n) {
+    int waiting = 0;
+    for (struct client *p = *lobby_adr; p != NULL; p = p->next) {
+        waiting++;
+    }
+    struct client **cut = lobby_adr;
+    for (int i = 0; i < waiting - n; i++) {
+        cut = &(*cut)->next;
+    }
+    struct client *players = *cut;
+    *cut = NULL;
+    return players;
+}
+
+/* Return the worker with the fewest players, counting those handed off to it that it
+ * hasn't taken yet.
+ */
+struct worker *least_loaded(struct worker *workers, int num_workers) {
+    struct worker *best = NULL;
+    int best_load = 0;
+    for (int i = 0; i < num_workers; i++) {
+        // taken is published after players, so players already counts everyone taken.
+        int taken = __atomic_load_n(&(workers[i].taken), __ATOMIC_ACQUIRE);
+        int load = __atomic_load_n(&(workers[i].players), __ATOMIC_RELAXED) + workers[i].sent - taken;
+        if (best == NULL || load < best_load) {
+            best = &workers[i];
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/* Take at least least and at most most of the seats counted in *open_seats, and return
+ * how many were taken, or 0 if fewer than least are open. The main thread takes seats
+ * before handing players to a worker, and a worker takes a room's seats before closing
+ * it, so seats the main thread has taken are never closed before their players arrive.
+ */
+int take_seats(int *open_seats, int least, int most) {
+    int open = __atomic_load_n(open_seats, __ATOMIC_RELAXED);
+    int n;
+    do {
+        if (open < least) {
+            return 0;
+        }
+        n = open < most ? open : most;
+    } while (!__atomic_compare_exchange_n(open_seats, &open, open - n, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return n;
+}
+
+/* Fill *fds with what the main thread polls: listenfd first, then every client in
+ * new_players and lobby. The lists change as clients come and go, so this is done
+ * every pass. *fds_size is how many entries *fds has room for, and *fds is grown
+ * as needed. Return the number of entries filled in.
+ */
+int watch_clients(struct pollfd **fds, int *fds_size, int listenfd, struct client *new_players, struct client *lobby) {
+    int num_fds = 1;
+    for (struct client *p = new_players; p != NULL; p = p->next) {
+        num_fds++;
+    }
+    for (struct client *p = lobby; p != NULL; p = p->next) {
+        num_fds++;
+    }
+    if (num_fds > *fds_size) {
+        *fds_size = num_fds * 2;
+        if (!(*fds = realloc(*fds, *fds_size * sizeof(struct pollfd)))) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    int n = 0;
+    (*fds)[n++] = (struct pollfd){listenfd, POLLIN, 0};
+    for (struct client *p = new_players; p != NULL; p = p->next) {
+        (*fds)[n++] = (struct pollfd){p->fd, POLLIN, 0};
+    }
+    for (struct client *p = lobby; p != NULL; p = p->next) {
+        (*fds)[n++] = (struct pollfd){p->fd, POLLIN, 0};
+    }
+    return n;
+}
+
+/* Turn away the client waiting on listenfd when we have no descriptor to accept it
+ * with. *spare_fd is given up so the client can be accepted and told the server is
+ * full, then taken back. Without this the client would sit in the listen queue and
+ * poll would keep waking us for it.
+ */
+void refuse_client(int listenfd, int *spare_fd) {
+    close(*spare_fd);
+    int clientfd = accept(listenfd, NULL, NULL);
+    if (clientfd != -1) {
+        fprintf(stderr, "[%d] refused, the server is full\n", clientfd);
+        if (write(clientfd, FULL_MSG, strlen(FULL_MSG)) == -1) {
+            perror("write");
+        }
+        close(clientfd);
+    }
+    *spare_fd = open("/dev/null", O_RDONLY);
+}
+
+/* Every client holds a socket descriptor, so allow ourselves as many descriptors as
+ * the system will let us have.
+ */
+void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        perror("getrlimit");
         return;
     }
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+            perror("setrlimit");
+        }
+    }
+}
+
+/* Start num_workers worker threads and return them.
+ */
+struct worker *start_workers(int num_workers) {
+    struct worker *workers = calloc(num_workers, sizeof(struct worker));
+    if (!workers) {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        struct worker *w = &workers[i];
+        if (pipe(w->wake_fd) == -1) {
+            perror("pipe");
+            exit(1);
+        }
+        // The main thread must never wait on a busy worker, and the worker drains
+        // the pipe until it is empty, so neither end may block.
+        for (int end = 0; end < 2; end++) {
+            int flags = fcntl(w->wake_fd[end], F_GETFL);
+            if (flags == -1 || fcntl(w->wake_fd[end], F_SETFL, flags | O_NONBLOCK) == -1) {
+                perror("fcntl");
+                exit(1);
+            }
+        }
+        if ((errno = pthread_create(&(w->thread), NULL, run_worker, w)) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    printf("Started %d workers.\n", num_workers);
+    return workers;
+}
 
-    printf("%s has just joined.\n", (game->head)->name);
-    announce_turn(game);
+/* Pass clients to worker w and wake it up. See struct handoff.
+ */
+void hand_off(struct worker *w, int kind, int room_id, struct client *clients) {
+    struct handoff *h = malloc(sizeof(struct handoff));
+    if (!h) {
+        perror("malloc");
+        exit(1);
+    }
+    h->kind = kind;
+    h->room_id = room_id;
+    h->clients = clients;
+    for (struct client *p = clients; p != NULL; p = p->next) {
+        w->sent++;
+    }
+    mpsc_push(&(w->inbox), &(h->node));
+
+    // If the pipe is full the worker has wake ups pending anyway.
+    char wake = 0;
+    if (write(w->wake_fd[1], &wake, 1) == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("write");
+        exit(1);
+    }
+}
+
+/* The body of a worker thread. Runs a poll loop over the players of the rooms handed
+ * to worker arg, the same way main does for clients without a room. Their spectators
+ * are the spectator thread's, so however many there are the loop never goes near them.
+ */
+void *run_worker(void *arg) {
+    struct worker *w = arg;
+    struct game_state *game;
+    struct client *p;
+    int taken = 0; // Players taken from w's inbox so far.
+
+    while (1) {
+        int num_fds = watch_players(w);
+        // Don't block if a bot has a move to make.
+        int bots_due = 0;
+        for (game = w->rooms; game != NULL && !bots_due; game = game->next) {
+            bots_due = bot_to_move(game);
+        }
+        if (poll(w->fds, num_fds, bots_due ? 0 : -1) == -1) {
+            perror("poll");
+            continue;
+        }
+
+        if (w->fds[0].revents & POLLIN) { // fds[0] is the wake pipe.
+            taken += take_handoffs(w);
+        }
+
+        // As in main, look the client up again for every descriptor since handling
+        // input may remove clients.
+        for (int i = 1; i < num_fds; i++) {
+            if (w->fds[i].revents == 0) {
+                continue;
+            }
+            int cur_fd = w->fds[i].fd;
+            game = w->fd_rooms[i];
+
+            // Check if this socket descriptor is an active player.
+            for (p = game->head; p != NULL; p = p->next) {
+                if (cur_fd == p->fd) {
+                    handle_player_input(game, p);
+                    break;
+                }
+            }
+        }
+        play_bots(w);
+        // Last, since anything above can lose a room its last person: a bot's move drops anyone
+        // whose write fails. Left open, a room of bots alone would sit until poll woke us.
+        free_seats(w);
+        close_empty_rooms(w);
+
+        // Let the main thread know how busy we are, see least_loaded.
+        int players = 0;
+        for (game = w->rooms; game != NULL; game = game->next) {
+            players += count_humans(game);
+        }
+        __atomic_store_n(&(w->players), players, __ATOMIC_RELAXED);
+        __atomic_store_n(&(w->taken), taken, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* Drain worker w's wake pipe and carry out every handoff waiting in its inbox. Return
+ * the number of players taken.
+ */
+int take_handoffs(struct worker *w) {
+    char buf[64];
+    while (read(w->wake_fd[0], buf, sizeof(buf)) > 0);
+
+    int taken = 0;
+    struct mpsc_node *node = mpsc_take_all(&(w->inbox));
+    while (node != NULL) {
+        struct handoff *h = (struct handoff *)node;
+        node = node->next;
+        for (struct client *p = h->clients; p != NULL; p = p->next) {
+            taken++;
+        }
+        if (h->kind == HANDOFF_SEATS) {
+            seat_players(w, h->clients);
+        } else {
+            start_room(w, h->room_id, h->clients);
+        }
+        free(h);
+    }
+    return taken;
+}
+
+/* Fill w->fds with what worker w polls: its wake pipe first, then the socket of every
+ * person in its rooms, with each one's room in w->fd_rooms. Players come and go, so
+ * this is done every pass. Return the number of entries filled in.
+ */
+int watch_players(struct worker *w) {
+    int num_fds = 1;
+    for (struct game_state *game = w->rooms; game != NULL; game = game->next) {
+        for (struct client *p = game->head; p != NULL; p = p->next) {
+            num_fds += !p->bot;
+        }
+    }
+    if (num_fds > w->fds_size) {
+        w->fds_size = num_fds * 2;
+        w->fds = realloc(w->fds, w->fds_size * sizeof(struct pollfd));
+        w->fd_rooms = realloc(w->fd_rooms, w->fds_size * sizeof(struct game_state *));
+        if (!w->fds || !w->fd_rooms) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    int n = 0;
+    w->fds[n++] = (struct pollfd){w->wake_fd[0], POLLIN, 0};
+    for (struct game_state *game = w->rooms; game != NULL; game = game->next) {
+        for (struct client *p = game->head; p != NULL; p = p->next) {
+            if (!p->bot) { // Bots have no socket.
+                w->fd_rooms[n] = game;
+                w->fds[n++] = (struct pollfd){p->fd, POLLIN, 0};
+            }
+        }
+    }
+    return n;
+}
+
+/* Start room room_id on worker w with players (a non-empty list) and start its first game.
+ */
+void start_room(struct worker *w, int room_id, struct client *players) {
+    struct game_state *game = malloc(sizeof(struct game_state));
+    if (!game) {
+        perror("malloc");
+        exit(1);
+    }
+    game->id = room_id;
+    game->dict = &dict;
+    init_game(game);
+    game->head = players;
+    game->has_next_turn = players;
+    tell_spectators(&spectators, SPECTATE_BOARD, room_id, take_snapshot(game, 0), NULL);
+    game->next = w->rooms;
+    w->rooms = game;
+
+    char msg[MAX_MSG];
+    sprintf(msg, "Welcome to game %d!\r\n", room_id);
+    broadcast(game, msg);
+    broadcast_status(game, '\0');
+    if (game->has_next_turn != NULL) { // Players may have disconnected while we wrote to them.
+        announce_turn(game);
+    }
+}
+
+/* Seat players (a list) in worker w's rooms, in seats the main thread took for them.
+ * Each goes to the room with the most people that still has a free seat, so rooms fill
+ * up before emptier ones do.
+ */
+void seat_players(struct worker *w, struct client *players) {
+    while (players != NULL) {
+        struct client *p = players;
+        players = p->next;
+        w->seats_free--; // The main thread already took it from open_seats.
+
+        struct game_state *game = NULL;
+        int most = -1;
+        for (struct game_state *g = w->rooms; g != NULL; g = g->next) {
+            int humans = count_humans(g);
+            if (humans < room_size && humans > most) {
+                game = g;
+                most = humans;
+            }
+        }
+        if (game == NULL) { // Can't happen, take_seats keeps the seat open until p gets here.
+            fprintf(stderr, "[%d] has no seat to take\n", p->fd);
+            p->next = NULL;
+            remove_player(&p, p->fd, NULL);
+            continue;
+        }
+
+        char msg[MAX_MSG];
+        sprintf(msg, "%s has just joined.\r\n", p->name); // null terminates msg
+        broadcast(game, msg);
+        p->next = game->head;
+        game->head = p;
+        printf("%s joined game %d.\n", p->name, game->id);
+
+        sprintf(msg, "Welcome to game %d!\r\n", game->id);
+        if (safe_write(&(game->head), p, msg, game) == -1) {
+            continue;
+        }
+        if (safe_write(&(game->head), p, status_message(msg, game), game) == -1) {
+            continue;
+        }
+        if (game->has_next_turn == NULL) { // No one was left to take a turn.
+            game->has_next_turn = p;
+            announce_turn(game);
+        } else {
+            sprintf(msg, "It's %s's turn.\r\n", (game->has_next_turn)->name);
+            safe_write(&(game->head), p, msg, game);
+        }
+    }
+}
+
+/* Count the seats people have left in worker w's rooms, and new rooms have brought,
+ * since the last call in w->open_seats, so the main thread can fill them.
+ */
+void free_seats(struct worker *w) {
+    int seats = 0;
+    for (struct game_state *game = w->rooms; game != NULL; game = game->next) {
+        seats += room_size - count_humans(game);
+    }
+    __atomic_add_fetch(&(w->open_seats), seats - w->seats_free, __ATOMIC_RELEASE);
+    w->seats_free = seats;
+}
+
+/* Close the rooms of worker w whose human players have all left, sending their spectators
+ * away. Any bots left in the room go with it. A room is kept open while the main thread
+ * has taken its seats, see take_seats.
+ */
+void close_empty_rooms(struct worker *w) {
+    struct game_state **game = &(w->rooms);
+    while (*game != NULL) {
+        if (has_humans(*game) || take_seats(&(w->open_seats), room_size, room_size) == 0) {
+            game = &(*game)->next;
+            continue;
+        }
+        w->seats_free -= room_size;
+
+        printf("Closing game %d.\n", (*game)->id);
+        while ((*game)->head != NULL) { // Only bots are left.
+            remove_player(&((*game)->head), (*game)->head->fd, NULL);
+        }
+        tell_spectators(&spectators, SPECTATE_CLOSE, (*game)->id, NULL, NULL);
+
+        struct game_state *t = (*game)->next;
+        free(*game);
+        *game = t;
+    }
+}
+
+/* Return the number of players in game who are people rather than bots.
+ */
+int count_humans(struct game_state *game) {
+    int humans = 0;
+    for (struct client *p = game->head; p != NULL; p = p->next) {
+        humans += !p->bot;
+    }
+    return humans;
+}
+
+/* Return 1 if any player in game is a person rather than a bot, 0 otherwise.
+ */
+int has_humans(struct game_state *game) {
+    for (struct client *p = game->head; p != NULL; p = p->next) {
+        if (!p->bot) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Add a bot player to game and return 0, or return -1 if game already has room_size
+ * bots. A bot is named bot<n> for the lowest n no one in the room is using, and has
+ * fd -n so remove_player can tell it apart. Bot names only need to be unique in their
+ * room, so they are not reserved in the name registry and never keep people out.
+ */
+int add_bot(struct game_state *game) {
+    int bots = 0;
+    for (struct client *p = game->head; p != NULL; p = p->next) {
+        bots += p->bot;
+    }
+    if (bots >= room_size) {
+        return -1;
+    }
+
+    char name[MAX_NAME];
+    int n = 0;
+    struct client *p;
+    do {
+        sprintf(name, "bot%d", ++n);
+        for (p = game->head; p != NULL && strcmp(p->name, name) != 0; p = p->next);
+    } while (p != NULL);
+
+    char *copy = strdup(name);
+    if (!copy) {
+        perror("strdup");
+        exit(1);
+    }
+    struct in_addr none = {0};
+    add_player(&(game->head), -n, none);
+    (game->head)->name = copy;
+    (game->head)->bot = 1;
+
+    char msg[MAX_MSG];
+    sprintf(msg, "%s has just joined.\r\n", name); // null terminates msg
+    broadcast(game, msg);
+    return 0;
+}
+
+/* Return 1 if it is a bot's turn in game and there is someone to play against, 0 otherwise.
+ */
+int bot_to_move(struct game_state *game) {
+    return game->has_next_turn != NULL && (game->has_next_turn)->bot && has_humans(game);
+}
+
+/* Make one move for every bot of worker w whose turn it is. Bots guess the letter the
+ * solver says is most likely, so they play about as well as /hint suggests. Only one
+ * move per room is made per pass through the poll loop, so the people in other rooms
+ * never wait long on bots.
+ */
+void play_bots(struct worker *w) {
+    for (struct game_state *game = w->rooms; game != NULL; game = game->next) {
+        if (!bot_to_move(game)) {
+            continue;
+        }
+        char letter = best_letter(&solver, game);
+        for (int c = 0; letter == '\0' && c < NUM_LETTERS; c++) { // No word fits, take any new letter.
+            if (!game->letters_guessed[c]) {
+                letter = 'a' + c;
+            }
+        }
+        printf("%s guesses %c.\n", (game->has_next_turn)->name, letter);
+        play_guess(game, game->has_next_turn, letter);
+    }
 }